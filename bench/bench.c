@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// Runs each benchmark program through the interpreter a number of times and
+// reports the median and 95th percentile wall time, the peak resident set
+// size and what the collector allocated. Given a baseline file, fails when a
+// benchmark got slower, bigger or allocated more than the tolerance allows.
+//
+// usage: bench [-n runs] [-b baseline] [-w] interpreter program.scm...
+//
+// With -w the baseline is written from this run instead of checked.
+
+#define MAX_RUNS 100
+#define MAX_BENCHES 64
+
+// Slowdowns of less than this fraction of the baseline, or of less than
+// TIME_SLACK_MS, are taken to be noise
+#define TIME_TOLERANCE 0.25
+#define TIME_SLACK_MS 5.0
+#define RSS_TOLERANCE 0.25
+#define RSS_SLACK_KB 1024
+#define ALLOC_TOLERANCE 0.05
+
+// The measurements of one benchmark
+typedef struct Result Result;
+struct Result {
+    char name[256];
+    double medianMs;
+    double p95Ms;
+    long peakRssKb;
+    unsigned long objects;
+    size_t bytes;
+};
+
+// Returns the current time in milliseconds
+double nowMs() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1e6;
+}
+
+// Returns the name of the benchmark in the given path: the file name without
+// its directory or extension
+void benchName(char *path, char *name, size_t size) {
+    char *start = strrchr(path, '/');
+    start = start ? start + 1 : path;
+    snprintf(name, size, "%s", start);
+    char *dot = strrchr(name, '.');
+    if(dot) *dot = '\0';
+}
+
+// Runs the interpreter once on the given program and fills in the wall time,
+// peak RSS and allocation counts of result, which the collector reports on
+// stderr. Returns false if the interpreter couldn't be run or failed.
+bool runOnce(char *interpreter, char *program, double *ms, Result *result) {
+    int pipeFds[2];
+    if(pipe(pipeFds) < 0) return false;
+    double start = nowMs();
+    pid_t pid = fork();
+    if(pid < 0) return false;
+    if(pid == 0) {
+        int input = open(program, O_RDONLY);
+        int output = open("/dev/null", O_WRONLY);
+        if(input < 0 || output < 0) _exit(127);
+        dup2(input, 0);
+        dup2(output, 1);
+        dup2(pipeFds[1], 2);
+        close(pipeFds[0]);
+        execl(interpreter, interpreter, "--gc-stats", (char *)NULL);
+        _exit(127);
+    }
+    close(pipeFds[1]);
+    char stats[4096];
+    size_t length = 0;
+    ssize_t count;
+    while((count = read(pipeFds[0], stats + length, sizeof(stats) - 1 - length)) > 0) {
+        length += count;
+    }
+    stats[length] = '\0';
+    close(pipeFds[0]);
+
+    int status;
+    struct rusage usage;
+    if(wait4(pid, &status, 0, &usage) < 0) return false;
+    *ms = nowMs() - start;
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) return false;
+
+    unsigned long minor, major;
+    char *line = strstr(stats, "gc: ");
+    if(line == NULL || sscanf(line, "gc: %lu minor and %lu major collections, %zu bytes in %lu objects",
+        &minor, &major, &result->bytes, &result->objects) != 4) {
+        return false;
+    }
+    if(usage.ru_maxrss > result->peakRssKb) result->peakRssKb = usage.ru_maxrss;
+    return true;
+}
+
+// Compares two doubles for qsort
+int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Runs the given program the given number of times and fills in result
+bool runBench(char *interpreter, char *program, int runs, Result *result) {
+    double times[MAX_RUNS];
+    memset(result, 0, sizeof(Result));
+    benchName(program, result->name, sizeof(result->name));
+    for(int i = 0; i < runs; i++) {
+        if(!runOnce(interpreter, program, &times[i], result)) {
+            fprintf(stderr, "%s: the interpreter failed\n", result->name);
+            return false;
+        }
+    }
+    qsort(times, runs, sizeof(double), compareDoubles);
+    result->medianMs = runs % 2 ? times[runs / 2] :
+        (times[runs / 2 - 1] + times[runs / 2]) / 2;
+    int p95 = (int)(0.95 * (runs - 1) + 0.5);
+    result->p95Ms = times[p95];
+    return true;
+}
+
+// Reads the baseline results from the given file into baseline and returns
+// how many there are, or -1 if the file can't be read
+int readBaseline(char *path, Result *baseline) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) return -1;
+    int count = 0;
+    char line[512];
+    while(count < MAX_BENCHES && fgets(line, sizeof(line), file)) {
+        if(line[0] == '#' || line[0] == '\n') continue;
+        Result *result = &baseline[count];
+        if(sscanf(line, "%255s %lf %lf %ld %lu %zu", result->name, &result->medianMs,
+            &result->p95Ms, &result->peakRssKb, &result->objects, &result->bytes) == 6) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+// Writes the given results to the given file as a new baseline
+bool writeBaseline(char *path, Result *results, int count) {
+    FILE *file = fopen(path, "w");
+    if(file == NULL) return false;
+    fprintf(file, "# name median_ms p95_ms peak_rss_kb objects bytes\n");
+    for(int i = 0; i < count; i++) {
+        Result *r = &results[i];
+        fprintf(file, "%s %.1f %.1f %ld %lu %zu\n", r->name, r->medianMs, r->p95Ms,
+            r->peakRssKb, r->objects, r->bytes);
+    }
+    fclose(file);
+    return true;
+}
+
+// Returns the baseline result with the given name, or NULL if there isn't one
+Result *findBaseline(Result *baseline, int count, char *name) {
+    for(int i = 0; i < count; i++) {
+        if(!strcmp(baseline[i].name, name)) return &baseline[i];
+    }
+    return NULL;
+}
+
+// Prints why the given result regressed from its baseline, if it did, and
+// returns whether it did
+bool checkRegression(Result *result, Result *base) {
+    bool regressed = false;
+    if(result->medianMs > base->medianMs * (1 + TIME_TOLERANCE) + TIME_SLACK_MS) {
+        printf("  %s: median %.1f ms, baseline %.1f ms\n", result->name,
+            result->medianMs, base->medianMs);
+        regressed = true;
+    }
+    if(result->peakRssKb > base->peakRssKb * (1 + RSS_TOLERANCE) + RSS_SLACK_KB) {
+        printf("  %s: peak RSS %ld KB, baseline %ld KB\n", result->name,
+            result->peakRssKb, base->peakRssKb);
+        regressed = true;
+    }
+    if(result->objects > base->objects * (1 + ALLOC_TOLERANCE)) {
+        printf("  %s: %lu objects allocated, baseline %lu\n", result->name,
+            result->objects, base->objects);
+        regressed = true;
+    }
+    return regressed;
+}
+
+int main(int argc, char *argv[]) {
+    int runs = 5;
+    char *baselinePath = NULL;
+    bool write = false;
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; arg++) {
+        if(!strcmp(argv[arg], "-n") && arg + 1 < argc) runs = atoi(argv[++arg]);
+        else if(!strcmp(argv[arg], "-b") && arg + 1 < argc) baselinePath = argv[++arg];
+        else if(!strcmp(argv[arg], "-w")) write = true;
+        else break;
+    }
+    if(argc - arg < 2 || runs < 1 || runs > MAX_RUNS || argc - arg - 1 > MAX_BENCHES ||
+        (write && baselinePath == NULL)) {
+        fprintf(stderr, "usage: %s [-n runs] [-b baseline] [-w] interpreter program.scm...\n", argv[0]);
+        return 2;
+    }
+    char *interpreter = argv[arg++];
+
+    static Result results[MAX_BENCHES];
+    static Result baseline[MAX_BENCHES];
+    int baselineCount = 0;
+    if(baselinePath != NULL && !write) {
+        baselineCount = readBaseline(baselinePath, baseline);
+        if(baselineCount < 0) {
+            fprintf(stderr, "can't read baseline %s\n", baselinePath);
+            return 2;
+        }
+    }
+
+    printf("%-16s %10s %10s %12s %12s %14s\n", "benchmark", "median ms", "p95 ms",
+        "peak RSS KB", "objects", "bytes");
+    int count = 0;
+    bool failed = false;
+    for(; arg < argc; arg++) {
+        Result *result = &results[count];
+        if(!runBench(interpreter, argv[arg], runs, result)) {
+            failed = true;
+            continue;
+        }
+        printf("%-16s %10.1f %10.1f %12ld %12lu %14zu\n", result->name, result->medianMs,
+            result->p95Ms, result->peakRssKb, result->objects, result->bytes);
+        count++;
+    }
+
+    if(write) {
+        if(!writeBaseline(baselinePath, results, count)) {
+            fprintf(stderr, "can't write baseline %s\n", baselinePath);
+            return 2;
+        }
+        printf("wrote %s\n", baselinePath);
+    } else if(baselinePath != NULL) {
+        int regressions = 0;
+        for(int i = 0; i < count; i++) {
+            Result *base = findBaseline(baseline, baselineCount, results[i].name);
+            if(base == NULL) printf("  %s: no baseline\n", results[i].name);
+            else if(checkRegression(&results[i], base)) regressions++;
+        }
+        if(regressions) {
+            printf("%d benchmark%s regressed\n", regressions, regressions == 1 ? "" : "s");
+            failed = true;
+        }
+    }
+    return failed ? 1 : 0;
+}
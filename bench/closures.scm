@@ -0,0 +1,24 @@
+(define make-counter
+    (lambda (start)
+        (let ((count start))
+            (lambda (step)
+                (begin
+                    (set! count (+ count step))
+                    count)))))
+
+(define compose
+    (lambda (f g)
+        (lambda (x) (f (g x)))))
+
+(define run
+    (lambda (n)
+        (letrec ((counter (make-counter 0))
+                 (add1 (lambda (x) (+ x 1)))
+                 (twice (compose add1 add1))
+                 (loop (lambda (i acc)
+                     (if (= i 0)
+                         acc
+                         (loop (- i 1) (+ acc (counter (twice i))))))))
+            (loop n 0))))
+
+(run 300000)
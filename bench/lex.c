@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "value.h"
+#include "gc.h"
+#include "source.h"
+#include "scan.h"
+#include "tokenizer.h"
+
+// Measures how fast the tokenizer reads a program, in megabytes per second,
+// with each set of scanners the processor can run. Only tokens are read, so
+// nothing is parsed or evaluated.
+//
+// usage: lex [-n runs] program.scm
+
+#define MAX_RUNS 100
+
+// Returns the current time in milliseconds
+double nowMs() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1e6;
+}
+
+// Compares two doubles for qsort
+int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Reads every token of the given program once, fills in how many bytes and
+// tokens there were and returns how long it took in milliseconds, or a
+// negative number if the program can't be opened
+double lexOnce(char *program, size_t *bytes, unsigned long *tokens) {
+    int fd = open(program, O_RDONLY);
+    if(fd < 0) return -1;
+    double start = nowMs();
+    Source source;
+    openSource(&source, fd);
+    *tokens = 0;
+    while(readToken(&source) != NULL) (*tokens)++;
+    double ms = nowMs() - start;
+    *bytes = source.length;
+    closeSource(&source);
+    close(fd);
+    return ms;
+}
+
+int main(int argc, char *argv[]) {
+    gcInit(__builtin_frame_address(0));
+    int runs = 5;
+    int arg = 1;
+    if(arg + 1 < argc && !strcmp(argv[arg], "-n")) {
+        runs = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+    if(argc - arg != 1 || runs < 1 || runs > MAX_RUNS) {
+        fprintf(stderr, "usage: %s [-n runs] program.scm\n", argv[0]);
+        return 2;
+    }
+    char *program = argv[arg];
+
+    printf("%-8s %12s %12s %12s\n", "scanner", "median MB/s", "best MB/s", "tokens");
+    for(scanLevel level = SCALAR_SCAN; level <= AVX2_SCAN; level++) {
+        if(initScanner(level) != level) continue;
+        double times[MAX_RUNS];
+        size_t bytes;
+        unsigned long tokens;
+        for(int i = 0; i < runs; i++) {
+            times[i] = lexOnce(program, &bytes, &tokens);
+            if(times[i] < 0) {
+                fprintf(stderr, "can't open %s\n", program);
+                return 1;
+            }
+        }
+        qsort(times, runs, sizeof(double), compareDoubles);
+        double median = runs % 2 ? times[runs / 2] :
+            (times[runs / 2 - 1] + times[runs / 2]) / 2;
+        double megabytes = bytes / 1e6;
+        printf("%-8s %12.1f %12.1f %12lu\n", scanLevelName(level),
+            megabytes / (median / 1000), megabytes / (times[0] / 1000), tokens);
+    }
+    return 0;
+}
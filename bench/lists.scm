@@ -0,0 +1,31 @@
+(define build
+    (lambda (n acc)
+        (if (= n 0)
+            acc
+            (build (- n 1) (cons n acc)))))
+
+(define sum
+    (lambda (list acc)
+        (if (null? list)
+            acc
+            (sum (cdr list) (+ acc (car list))))))
+
+(define rev
+    (lambda (list acc)
+        (if (null? list)
+            acc
+            (rev (cdr list) (cons (car list) acc)))))
+
+(define copy
+    (lambda (list)
+        (if (null? list)
+            list
+            (cons (car list) (copy (cdr list))))))
+
+(define repeat
+    (lambda (n acc)
+        (if (= n 0)
+            acc
+            (repeat (- n 1) (+ acc (sum (copy (rev (build 100000 (quote ())) (quote ()))) 0))))))
+
+(repeat 4 0)
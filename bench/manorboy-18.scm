@@ -0,0 +1,12 @@
+(define A
+    (lambda (k x1 x2 x3 x4 x5)
+        (letrec ((B
+            (lambda ()
+                (begin
+                    (set! k (- k 1))
+                    (A k B x1 x2 x3 x4)))))
+            (if (<= k 0)
+                (+ (x4) (x5))
+                (B)))))
+
+(A 18 (lambda () 1) (lambda () -1) (lambda () -1) (lambda () 1) (lambda () 0))
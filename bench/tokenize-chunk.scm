@@ -0,0 +1,11 @@
+; Repeated by the Makefile to make tokenize.scm, a large file to read
+(define data
+    (quote (alpha beta gamma delta 1 2 3 4.5 -6 "seven" #t #f
+            (nested (list of symbols) 123456 0.25 "a longer string literal")
+            (lambda (x y) (if (< x y) (cons x y) (car (cdr (list x y))))))))
+(define helper
+    (lambda (a b c)
+        (let ((d (+ a b)) (e (* b c)))
+            (cond ((> d e) (quote larger))
+                  ((= d e) (quote same))
+                  (else (quote smaller))))))
@@ -0,0 +1,522 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "gc.h"
+#include "resolver.h"
+#include "vm.h"
+#include "compiler.h"
+
+// The code being built for one lambda body or top level expression. depth is
+// the number of values the instructions so far leave on the stack.
+typedef struct Compiler Compiler;
+struct Compiler {
+    Compiler *enclosing;
+    uint32_t *ops;
+    int length;
+    int capacity;
+    Value **constants;
+    int constantCount;
+    int constantCapacity;
+    int depth;
+    int maxDepth;
+};
+
+// The innermost compiler that is running; its constants are roots
+Compiler *compiling = NULL;
+bool compilerRootsAdded = false;
+
+void compileExpr(Compiler *c, Value *expr, bool tail);
+
+// Visits the constants of every compiler that is running
+void visitCompilers() {
+    for(Compiler *c = compiling; c != NULL; c = c->enclosing) {
+        for(int i = 0; i < c->constantCount; i++) gcVisit((void **)&c->constants[i]);
+    }
+}
+
+// Initializes the given compiler with no code and makes it the innermost one
+void initCompiler(Compiler *c) {
+    assert(c);
+    if(!compilerRootsAdded) {
+        gcAddRoots(visitCompilers);
+        compilerRootsAdded = true;
+    }
+    c->enclosing = compiling;
+    c->capacity = 64;
+    c->length = 0;
+    c->ops = malloc(c->capacity * sizeof(uint32_t));
+    c->constantCapacity = 16;
+    c->constantCount = 0;
+    c->constants = malloc(c->constantCapacity * sizeof(Value *));
+    if(c->ops == NULL || c->constants == NULL) texit(1);
+    c->depth = 0;
+    c->maxDepth = 0;
+    compiling = c;
+}
+
+// Appends a word to the code
+void emit(Compiler *c, uint32_t word) {
+    if(c->length == c->capacity) {
+        c->capacity *= 2;
+        c->ops = realloc(c->ops, c->capacity * sizeof(uint32_t));
+        if(c->ops == NULL) texit(1);
+    }
+    c->ops[c->length] = word;
+    c->length++;
+}
+
+// Appends an instruction that changes the number of values on the stack by
+// the given amount
+void emitOp(Compiler *c, opcode op, int operand, int effect) {
+    assert(operand >= 0 && operand <= MAX_OPERAND);
+    emit(c, op | (uint32_t)operand << OPERAND_SHIFT);
+    c->depth += effect;
+    if(c->depth > c->maxDepth) c->maxDepth = c->depth;
+}
+
+// Appends a local variable instruction for the given address
+void emitLocal(Compiler *c, opcode op, Value *address, int effect) {
+    assert(typeOf(address) == LOCAL_TYPE);
+    emitOp(c, op, address->a.depth, effect);
+    emit(c, address->a.index);
+}
+
+// Appends the instruction that pushes what the slot at the given address
+// holds, using one of the short forms when it can. A slot holding a box is
+// never empty, and neither is one of a letrec whose initial values are all
+// lambdas once they have run.
+void emitLoadSlot(Compiler *c, Value *address) {
+    assert(typeOf(address) == LOCAL_TYPE);
+    bool assigned = address->a.assigned || address->a.boxed;
+    if(assigned && address->a.depth == 0) {
+        emitOp(c, OP_LOCAL0, address->a.index, 1);
+    } else if(assigned && address->a.depth == 1) {
+        emitOp(c, OP_LOCAL1, address->a.index, 1);
+    } else emitLocal(c, OP_LOCAL, address, 1);
+}
+
+// Appends the instructions that push the local variable at the given address
+void emitLoadLocal(Compiler *c, Value *address) {
+    emitLoadSlot(c, address);
+    if(address->a.boxed) emitOp(c, OP_UNBOX, 0, 0);
+}
+
+// Appends the instructions that pop into the local variable at the given
+// address for a define
+void emitStoreLocal(Compiler *c, Value *address) {
+    assert(typeOf(address) == LOCAL_TYPE);
+    if(address->a.boxed) {
+        emitLoadSlot(c, address);
+        emitOp(c, OP_STORE_BOX, 0, -2);
+    } else if(address->a.depth == 0) emitOp(c, OP_STORE_LOCAL0, address->a.index, -1);
+    else emitLocal(c, OP_STORE_LOCAL, address, -1);
+}
+
+// Appends the instructions that pop into the local variable at the given
+// address for a set!, which must find it assigned
+void emitAssignLocal(Compiler *c, Value *address) {
+    assert(typeOf(address) == LOCAL_TYPE);
+    if(address->a.boxed) {
+        emitLoadSlot(c, address);
+        emitOp(c, OP_ASSIGN_BOX, 0, -2);
+    } else emitLocal(c, OP_ASSIGN_LOCAL, address, -1);
+}
+
+// Returns the slots that hold boxes in the frame of the given body
+Value *boxedSlots(Value *body) {
+    assert(typeOf(body) == BODY_TYPE);
+    Value *expr = body->body.expr;
+    if(typeOf(expr) == CONS_TYPE && car(expr) == boxSymbol) return car(cdr(expr));
+    return makeNull();
+}
+
+// Appends the instructions that put the slots of the current frame that the
+// given body needs boxed into boxes, and returns the body's expression
+Value *emitBoxes(Compiler *c, Value *body) {
+    for(Value *cur = boxedSlots(body); !isNull(cur); cur = cdr(cur)) {
+        emitOp(c, OP_BOX, fixnumValue(car(cur)), 0);
+    }
+    Value *expr = body->body.expr;
+    if(typeOf(expr) == CONS_TYPE && car(expr) == boxSymbol) return car(cdr(cdr(expr)));
+    return expr;
+}
+
+// Appends an instruction that causes the given evaluation error. It counts as
+// pushing a value so that it can stand in for any expression.
+void emitError(Compiler *c, int errorCode) {
+    emitOp(c, OP_ERROR, errorCode, 1);
+}
+
+// Returns from the function if the expression just compiled was in tail
+// position
+void emitTail(Compiler *c, bool tail) {
+    if(tail) emitOp(c, OP_RETURN, 0, -1);
+}
+
+// Appends a jump whose target will be filled in by patchJump, and returns
+// where it is
+int emitJump(Compiler *c, opcode op, int effect) {
+    emitOp(c, op, 0, effect);
+    return c->length - 1;
+}
+
+// Makes the jump at the given position go to the end of the code so far
+void patchJump(Compiler *c, int jump) {
+    assert(c->length <= MAX_OPERAND);
+    c->ops[jump] |= (uint32_t)c->length << OPERAND_SHIFT;
+}
+
+// Returns the index of the given constant, adding it if it isn't there yet
+int addConstant(Compiler *c, Value *value) {
+    assert(value);
+    for(int i = 0; i < c->constantCount; i++) {
+        if(c->constants[i] == value) return i;
+    }
+    if(c->constantCount == c->constantCapacity) {
+        c->constantCapacity *= 2;
+        c->constants = realloc(c->constants, c->constantCapacity * sizeof(Value *));
+        if(c->constants == NULL) texit(1);
+    }
+    c->constants[c->constantCount] = value;
+    c->constantCount++;
+    return c->constantCount - 1;
+}
+
+// Copies the finished code into the collected heap, and makes the enclosing
+// compiler the innermost one again
+Code *finishCode(Compiler *c, int paramCount, int frameSize) {
+    assert(compiling == c);
+    size_t size = sizeof(Code) + c->constantCount * sizeof(Value *) +
+        c->length * sizeof(uint32_t);
+    Code *code = (Code *)gcAllocOld(size, CODE_OBJECT);
+    code->paramCount = paramCount;
+    code->frameSize = frameSize;
+    code->maxStack = c->maxDepth + 1;
+    code->length = c->length;
+    code->constantCount = c->constantCount;
+    code->calls = 0;
+    code->native = NULL;
+    code->ops = (uint32_t *)&code->constants[c->constantCount];
+    memcpy(code->constants, c->constants, c->constantCount * sizeof(Value *));
+    memcpy(code->ops, c->ops, c->length * sizeof(uint32_t));
+    compiling = c->enclosing;
+    free(c->ops);
+    free(c->constants);
+    return code;
+}
+
+// Compiles an if expression. Anything but #t counts as false.
+void compileIf(Compiler *c, Value *args, bool tail) {
+    compileExpr(c, car(args), false);
+    int elseJump = emitJump(c, OP_JUMP_IF_FALSE, -1);
+    compileExpr(c, car(cdr(args)), tail);
+    int endJump = -1;
+    if(!tail) {
+        endJump = emitJump(c, OP_JUMP, 0);
+        c->depth--;
+    }
+    patchJump(c, elseJump);
+    compileExpr(c, car(cdr(cdr(args))), tail);
+    if(!tail) patchJump(c, endJump);
+}
+
+// Compiles a cond expression. The clauses are checked as they're reached, so
+// a malformed clause only causes an error if the ones before it are false.
+void compileCond(Compiler *c, Value *args, bool tail) {
+    if(isNull(args)) {
+        emitOp(c, OP_VOID, 0, 1);
+        emitTail(c, tail);
+        return;
+    }
+    int *endJumps = malloc(length(args) * sizeof(int));
+    if(endJumps == NULL) texit(1);
+    int jumpCount = 0;
+    Value *cur = args;
+    bool failed = false;
+    while(!isNull(cdr(cur))) {
+        Value *clause = car(cur);
+        if(typeOf(clause) != CONS_TYPE || length(clause) != 2) {
+            emitError(c, 28);
+            emitTail(c, tail);
+            failed = true;
+            break;
+        }
+        compileExpr(c, car(clause), false);
+        emitOp(c, OP_CHECK_BOOL, 28, 0);
+        int nextJump = emitJump(c, OP_JUMP_IF_FALSE, -1);
+        compileExpr(c, car(cdr(clause)), tail);
+        if(!tail) {
+            endJumps[jumpCount] = emitJump(c, OP_JUMP, 0);
+            jumpCount++;
+            c->depth--;
+        }
+        patchJump(c, nextJump);
+        cur = cdr(cur);
+    }
+
+    Value *clause = car(cur);
+    if(failed) {
+        // the clauses after a malformed one are never reached
+    } else if(typeOf(clause) == BOOL_TYPE && clause->i) {
+        emitOp(c, OP_CONSTANT, addConstant(c, clause), 1);
+        emitTail(c, tail);
+    } else if(typeOf(clause) != CONS_TYPE || length(clause) != 2) {
+        emitError(c, 28);
+        emitTail(c, tail);
+    } else if(car(clause) == elseSymbol) {
+        compileExpr(c, car(cdr(clause)), tail);
+    } else {
+        compileExpr(c, car(clause), false);
+        emitOp(c, OP_CHECK_BOOL, 28, 0);
+        int voidJump = emitJump(c, OP_JUMP_IF_FALSE, -1);
+        compileExpr(c, car(cdr(clause)), tail);
+        if(!tail) {
+            endJumps[jumpCount] = emitJump(c, OP_JUMP, 0);
+            jumpCount++;
+            c->depth--;
+        }
+        patchJump(c, voidJump);
+        emitOp(c, OP_VOID, 0, 1);
+        emitTail(c, tail);
+    }
+    for(int i = 0; i < jumpCount; i++) patchJump(c, endJumps[i]);
+    free(endJumps);
+}
+
+// Compiles an and or an or expression, which take exactly two booleans.
+// shortCircuit is the jump that skips the second argument. In tail position
+// the second argument is checked when the function returns, so that it can
+// be a tail call.
+void compileLogic(Compiler *c, Value *args, int arityError, int typeError,
+                  opcode shortCircuit, bool tail) {
+    if(length(args) != 2) {
+        emitError(c, arityError);
+        emitTail(c, tail);
+        return;
+    }
+    compileExpr(c, car(args), false);
+    emitOp(c, OP_CHECK_BOOL, typeError, 0);
+    emitOp(c, OP_DUP, 0, 1);
+    int endJump = emitJump(c, shortCircuit, -1);
+    emitOp(c, OP_POP, 0, -1);
+    if(tail) {
+        emitOp(c, OP_CHECK_RETURN, typeError, 0);
+        compileExpr(c, car(cdr(args)), true);
+        c->depth++;
+    } else {
+        compileExpr(c, car(cdr(args)), false);
+        emitOp(c, OP_CHECK_BOOL, typeError, 0);
+    }
+    patchJump(c, endJump);
+    emitTail(c, tail);
+}
+
+// Compiles the expression of the body of a let, let* or letrec expression,
+// which runs in the frame they entered. In tail position returning leaves the
+// frame anyway.
+void compileBody(Compiler *c, Value *expr, bool tail) {
+    compileExpr(c, expr, tail);
+    if(!tail) emitOp(c, OP_LEAVE, 0, 0);
+}
+
+// Compiles a let expression. The initial values are pushed in the enclosing
+// frame and become the first slots of the new one.
+void compileLet(Compiler *c, Value *args, bool tail) {
+    Value *body = car(cdr(args));
+    assert(typeOf(body) == BODY_TYPE);
+    int count = 0;
+    Value *cur = car(args);
+    while(!isNull(cur)) {
+        compileExpr(c, car(cur), false);
+        count++;
+        cur = cdr(cur);
+    }
+    emitOp(c, OP_ENTER, body->body.frameSize, -count);
+    emit(c, count);
+    compileBody(c, emitBoxes(c, body), tail);
+}
+
+// Fills in the given slot of a letrec's frame, which has just been stored,
+// in the closures that the lambdas among the first initial values made while
+// it was still empty. Boxed slots were never empty.
+void emitLetRecCaptures(Compiler *c, Value *inits, int slot) {
+    int index = 0;
+    for(Value *cur = inits; index <= slot; cur = cdr(cur), index++) {
+        Value *init = car(cur);
+        if(typeOf(init) != CONS_TYPE || car(init) != lambdaSymbol) continue;
+        int capture = 0;
+        for(Value *address = car(cdr(cdr(cdr(init)))); !isNull(address); address = cdr(address)) {
+            Value *variable = car(address);
+            if(variable->a.depth == 0 && variable->a.index == slot && !variable->a.boxed) {
+                emitOp(c, OP_LOCAL0, index, 1);
+                emitOp(c, OP_LOCAL0, slot, 1);
+                emitOp(c, OP_CAPTURE, capture, -2);
+            }
+            capture++;
+        }
+    }
+}
+
+// Compiles a let* or letrec expression. The initial values are evaluated in
+// the new frame and stored one at a time, into boxes for the variables that
+// need them.
+void compileLetStar(Compiler *c, Value *args, bool tail, bool letrec) {
+    Value *body = car(cdr(args));
+    assert(typeOf(body) == BODY_TYPE);
+    emitOp(c, OP_ENTER, body->body.frameSize, 0);
+    emit(c, 0);
+    Value *boxed = boxedSlots(body);
+    Value *expr = emitBoxes(c, body);
+    int index = 0;
+    Value *cur = car(args);
+    while(!isNull(cur)) {
+        compileExpr(c, car(cur), false);
+        if(!isNull(boxed) && fixnumValue(car(boxed)) == index) {
+            emitOp(c, OP_LOCAL0, index, 1);
+            emitOp(c, OP_STORE_BOX, 0, -2);
+            boxed = cdr(boxed);
+        } else emitOp(c, OP_STORE_LOCAL0, index, -1);
+        if(letrec) emitLetRecCaptures(c, car(args), index);
+        index++;
+        cur = cdr(cur);
+    }
+    compileBody(c, expr, tail);
+}
+
+// Compiles a define or set! expression, which store into the resolved
+// variable and evaluate to void
+void compileAssignment(Compiler *c, Value *args, opcode localOp, opcode globalOp,
+                       bool tail) {
+    Value *variable = car(args);
+    compileExpr(c, car(cdr(args)), false);
+    if(typeOf(variable) == LOCAL_TYPE && localOp == OP_STORE_LOCAL) {
+        emitStoreLocal(c, variable);
+    } else if(typeOf(variable) == LOCAL_TYPE) emitAssignLocal(c, variable);
+    else emitOp(c, globalOp, addConstant(c, variable), -1);
+    emitOp(c, OP_VOID, 0, 1);
+    emitTail(c, tail);
+}
+
+// Compiles a lambda expression into instructions that push what the slots of
+// the variables it captures hold, which are boxes for the ones that have
+// them, and a closure instruction for the code of its body that takes them.
+// The slots of its own frame are pushed even if they're still empty, since
+// only a letrec's lambdas can see them so and it fills them in once stored.
+void compileLambda(Compiler *c, Value *args, bool tail) {
+    Value *body = car(cdr(args));
+    assert(typeOf(body) == BODY_TYPE);
+    Compiler inner;
+    initCompiler(&inner);
+    compileExpr(&inner, emitBoxes(&inner, body), true);
+    Code *code = finishCode(&inner, length(car(args)), body->body.frameSize);
+    int count = 0;
+    for(Value *cur = car(cdr(cdr(args))); !isNull(cur); cur = cdr(cur)) {
+        Value *address = car(cur);
+        if(address->a.depth == 0) emitOp(c, OP_LOCAL0, address->a.index, 1);
+        else emitLoadSlot(c, address);
+        count++;
+    }
+    emitOp(c, OP_CLOSURE, addConstant(c, (Value *)code), 1 - count);
+    emit(c, count);
+    emitTail(c, tail);
+}
+
+// Compiles a begin expression, dropping the value of all but the last
+// expression
+void compileBegin(Compiler *c, Value *args, bool tail) {
+    if(isNull(args)) {
+        emitOp(c, OP_VOID, 0, 1);
+        emitTail(c, tail);
+        return;
+    }
+    Value *cur = args;
+    while(!isNull(cdr(cur))) {
+        compileExpr(c, car(cur), false);
+        emitOp(c, OP_POP, 0, -1);
+        cur = cdr(cur);
+    }
+    compileExpr(c, car(cur), tail);
+}
+
+// Compiles a function call. The function and the arguments are evaluated
+// left to right.
+void compileCall(Compiler *c, Value *expr, bool tail) {
+    Value *first = car(expr);
+    if(typeOf(first) != CONS_TYPE && typeOf(first) != LOCAL_TYPE &&
+        typeOf(first) != BINDING_TYPE) {
+        emitError(c, 3);
+        emitTail(c, tail);
+        return;
+    }
+    int count = 0;
+    Value *cur = expr;
+    while(!isNull(cur)) {
+        compileExpr(c, car(cur), false);
+        count++;
+        cur = cdr(cur);
+    }
+    if(tail) emitOp(c, OP_TAILCALL, count - 1, -count);
+    else emitOp(c, OP_CALL, count - 1, 1 - count);
+}
+
+// Compiles the given resolved expression. An expression in tail position
+// returns its value from the function instead of pushing it.
+void compileExpr(Compiler *c, Value *expr, bool tail) {
+    assert(expr);
+    if(typeOf(expr) == INT_TYPE || typeOf(expr) == BIGNUM_TYPE ||
+        typeOf(expr) == DOUBLE_TYPE || typeOf(expr) == BOOL_TYPE ||
+        typeOf(expr) == STR_TYPE || typeOf(expr) == NULL_TYPE ||
+        typeOf(expr) == VECTOR_TYPE) {
+        emitOp(c, OP_CONSTANT, addConstant(c, expr), 1);
+        emitTail(c, tail);
+    } else if(typeOf(expr) == LOCAL_TYPE) {
+        emitLoadLocal(c, expr);
+        emitTail(c, tail);
+    } else if(typeOf(expr) == BINDING_TYPE) {
+        emitOp(c, OP_GLOBAL, addConstant(c, expr), 1);
+        emitTail(c, tail);
+    } else if(typeOf(expr) == ERROR_TYPE) {
+        emitError(c, expr->i);
+        emitTail(c, tail);
+    } else if(typeOf(expr) == CONS_TYPE) {
+        Value *first = car(expr);
+        Value *args = cdr(expr);
+        if(first == ifSymbol) compileIf(c, args, tail);
+        else if(first == condSymbol) compileCond(c, args, tail);
+        else if(first == andSymbol) compileLogic(c, args, 24, 25, OP_JUMP_IF_FALSE, tail);
+        else if(first == orSymbol) compileLogic(c, args, 26, 27, OP_JUMP_IF_TRUE, tail);
+        else if(first == letSymbol) compileLet(c, args, tail);
+        else if(first == letStarSymbol) compileLetStar(c, args, tail, false);
+        else if(first == letRecSymbol) compileLetStar(c, args, tail, true);
+        else if(first == quoteSymbol) {
+            emitOp(c, OP_CONSTANT, addConstant(c, car(args)), 1);
+            emitTail(c, tail);
+        }
+        else if(first == defineSymbol) {
+            compileAssignment(c, args, OP_STORE_LOCAL, OP_STORE_GLOBAL, tail);
+        }
+        else if(first == setSymbol) {
+            compileAssignment(c, args, OP_ASSIGN_LOCAL, OP_ASSIGN_GLOBAL, tail);
+        }
+        else if(first == lambdaSymbol) compileLambda(c, args, tail);
+        else if(first == beginSymbol) compileBegin(c, args, tail);
+        else compileCall(c, expr, tail);
+    } else {
+        emitError(c, 7);
+        emitTail(c, tail);
+    }
+}
+
+// Compiles a resolved top level expression into code that returns its value
+Code *compile(Value *expr) {
+    assert(expr);
+    Compiler c;
+    initCompiler(&c);
+    compileExpr(&c, expr, true);
+    return finishCode(&c, 0, 0);
+}
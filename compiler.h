@@ -0,0 +1,12 @@
+#include "value.h"
+#include "vm.h"
+
+#ifndef _COMPILER
+#define _COMPILER
+
+// Compiles an expression that has been through resolve into code for the
+// virtual machine. Never fails: syntax errors compile into instructions that
+// cause the error at the point where evaluation reaches them.
+Code *compile(Value *expr);
+
+#endif
@@ -0,0 +1,786 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+#include <assert.h>
+#include "value.h"
+#include "interpreter.h"
+#include "vm.h"
+#include "gc.h"
+
+// The heap has two generations. New objects are bump allocated in the nursery,
+// a contiguous run of small pages. When it fills up, a minor collection copies
+// the survivors into the old generation, which is made of aligned blocks: a
+// small block is cut into cells of one size class and a large block holds a
+// single object, so the object containing any address can be found by masking
+// and dividing. The old generation is collected by mark and sweep.
+//
+// The C stack is scanned conservatively, so objects it seems to point to can't
+// be moved. A nursery page holding such an object is pinned: it is retired
+// into the old generation in place and comes back once it is empty again.
+#define BLOCK_SIZE (64 * 1024)
+#define GRANULE 8
+#define MAX_SMALL 512
+#define SIZE_CLASSES (MAX_SMALL / GRANULE + 1)
+#ifndef MIN_THRESHOLD
+#define MIN_THRESHOLD (4 * 1024 * 1024)
+#endif
+#define NURSERY_PAGE_SIZE 4096
+#ifndef NURSERY_PAGES
+#define NURSERY_PAGES 256
+#endif
+#define NURSERY_SIZE (NURSERY_PAGE_SIZE * NURSERY_PAGES)
+#define PAGE_GRANULES (NURSERY_PAGE_SIZE / GRANULE)
+#define MAX_ROOT_SETS 16
+#ifndef FRAME_STACK_SIZE
+#define FRAME_STACK_SIZE (4 * 1024 * 1024)
+#endif
+
+// Precedes every object; the pointer handed out points just past it. A
+// forwarded object holds the address of its copy in its first word.
+typedef struct Header Header;
+struct Header {
+    uint32_t size;
+    uint8_t kind;
+    uint8_t marked;
+    uint8_t remembered;
+    uint8_t forwarded;
+};
+
+typedef struct Block Block;
+struct Block {
+    Block *next;
+    size_t cellSize;
+    size_t cellCount;
+    char *cells;
+};
+
+// Bookkeeping for one page of the nursery. starts has a bit set for every
+// granule where an object begins, so interior pointers can be resolved.
+typedef struct NurseryPage NurseryPage;
+struct NurseryPage {
+    char *top;
+    bool old;
+    bool pinned;
+    uint64_t starts[PAGE_GRANULES / 64];
+};
+
+typedef enum {NO_COLLECTION,MINOR_COLLECTION,MAJOR_COLLECTION} collectionMode;
+
+Block *blocks = NULL;
+Header *freeLists[SIZE_CLASSES];
+uintptr_t heapLow = UINTPTR_MAX;
+uintptr_t heapHigh = 0;
+void *stackBase = NULL;
+
+char *nursery = NULL;
+NurseryPage pages[NURSERY_PAGES];
+int currentPage = -1;
+char *nurseryTop = NULL;
+char *nurseryLimit = NULL;
+
+// Open addressing table from the address of every BLOCK_SIZE chunk of the old
+// generation to the block that contains it
+uintptr_t *mapKeys = NULL;
+Block **mapBlocks = NULL;
+size_t mapCapacity = 0;
+size_t mapCount = 0;
+
+// Objects that have been reached but whose children haven't been visited yet
+Header **grayStack = NULL;
+size_t grayCount = 0;
+size_t grayCapacity = 0;
+
+// Old objects that may point into the nursery
+Header **rememberedSet = NULL;
+size_t rememberedCount = 0;
+size_t rememberedCapacity = 0;
+
+void (*rootSets[MAX_ROOT_SETS])();
+int rootSetCount = 0;
+
+// The frame stack holds frames that are popped instead of collected. It is
+// outside the heap, so the collector never moves or frees them; their slots
+// are roots until they're popped.
+char *frameStack = NULL;
+void *gcFrameTop = NULL;
+void *gcFrameLow = NULL;
+
+collectionMode mode = NO_COLLECTION;
+size_t promotedSinceMajor = 0;
+size_t threshold = MIN_THRESHOLD;
+GCStats stats;
+
+// Returns the header of the object that the given payload pointer belongs to
+Header *headerOf(void *p) {
+    return (Header *)p - 1;
+}
+
+// Pushes the given header onto the given growable array
+void pushHeader(Header ***array, size_t *count, size_t *capacity, Header *header) {
+    if(*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 1024;
+        *array = (Header **)realloc(*array, *capacity * sizeof(Header *));
+        if(*array == NULL) exit(1);
+    }
+    (*array)[(*count)++] = header;
+}
+
+// Returns the index of the nursery page containing p, or -1 if p isn't in the
+// nursery
+int pageIndex(void *p) {
+    uintptr_t offset = (uintptr_t)p - (uintptr_t)nursery;
+    if(nursery == NULL || offset >= NURSERY_SIZE) return -1;
+    return (int)(offset / NURSERY_PAGE_SIZE);
+}
+
+// Returns whether p points into a page of the nursery that hasn't been retired
+bool isYoung(void *p) {
+    int page = pageIndex(p);
+    return page >= 0 && !pages[page].old;
+}
+
+// Returns the first address of the given nursery page
+char *pageStart(int page) {
+    return nursery + (size_t)page * NURSERY_PAGE_SIZE;
+}
+
+// Returns the end of the objects allocated in the given nursery page
+char *pageTop(int page) {
+    if(page == currentPage) return nurseryTop;
+    return pages[page].top;
+}
+
+// Empties the given nursery page so it can be allocated into again
+void resetPage(int page) {
+    pages[page].top = pageStart(page);
+    pages[page].old = false;
+    pages[page].pinned = false;
+    memset(pages[page].starts, 0, sizeof(pages[page].starts));
+}
+
+// Moves nursery allocation to the first page at or after the given one that
+// hasn't been retired. Returns false if there is none.
+bool findNurseryPage(int from) {
+    if(currentPage >= 0) pages[currentPage].top = nurseryTop;
+    for(int i = from; i < NURSERY_PAGES; i++) {
+        if(!pages[i].old) {
+            currentPage = i;
+            nurseryTop = pageStart(i);
+            nurseryLimit = nurseryTop + NURSERY_PAGE_SIZE;
+            return true;
+        }
+    }
+    currentPage = -1;
+    nurseryTop = nurseryLimit = NULL;
+    return false;
+}
+
+// Bump allocates a cell of the given size in the nursery, returning NULL if
+// the nursery is full
+Header *allocYoung(size_t cellSize) {
+    if(nurseryTop == NULL) return NULL;
+    if((size_t)(nurseryLimit - nurseryTop) < cellSize) {
+        if(!findNurseryPage(currentPage + 1)) return NULL;
+    }
+    Header *header = (Header *)nurseryTop;
+    size_t granule = (nurseryTop - pageStart(currentPage)) / GRANULE;
+    pages[currentPage].starts[granule / 64] |= 1ull << (granule % 64);
+    nurseryTop += cellSize;
+    return header;
+}
+
+// Returns the header of the object in the nursery containing p, or NULL
+Header *findYoungObject(uintptr_t p) {
+    int page = pageIndex((void *)p);
+    if(p >= (uintptr_t)pageTop(page)) return NULL;
+    size_t granule = (p - (uintptr_t)pageStart(page)) / GRANULE;
+    int word = granule / 64;
+    uint64_t bits = pages[page].starts[word] & ((2ull << (granule % 64)) - 1);
+    while(bits == 0) {
+        if(--word < 0) return NULL;
+        bits = pages[page].starts[word];
+    }
+    int bit = 63 - __builtin_clzll(bits);
+    Header *header = (Header *)(pageStart(page) + (size_t)(word * 64 + bit) * GRANULE);
+    if(p >= (uintptr_t)header + header->size) return NULL;
+    if(header->kind == FREE_OBJECT) return NULL;
+    return header;
+}
+
+// Returns the slot of the block map where the given chunk is or should go
+size_t mapSlot(uintptr_t chunk) {
+    size_t mask = mapCapacity - 1;
+    size_t i = (size_t)((chunk / BLOCK_SIZE) * 0x9E3779B97F4A7C15ull) & mask;
+    while(mapKeys[i] != 0 && mapKeys[i] != chunk) i = (i + 1) & mask;
+    return i;
+}
+
+// Doubles the capacity of the block map
+void growBlockMap() {
+    uintptr_t *oldKeys = mapKeys;
+    Block **oldBlocks = mapBlocks;
+    size_t oldCapacity = mapCapacity;
+    mapCapacity = mapCapacity ? mapCapacity * 2 : 256;
+    mapKeys = (uintptr_t *)calloc(mapCapacity, sizeof(uintptr_t));
+    mapBlocks = (Block **)calloc(mapCapacity, sizeof(Block *));
+    if(mapKeys == NULL || mapBlocks == NULL) exit(1);
+    for(size_t i = 0; i < oldCapacity; i++) {
+        if(oldKeys[i] == 0) continue;
+        size_t slot = mapSlot(oldKeys[i]);
+        mapKeys[slot] = oldKeys[i];
+        mapBlocks[slot] = oldBlocks[i];
+    }
+    free(oldKeys);
+    free(oldBlocks);
+}
+
+// Adds every chunk of the given block to the block map
+void mapBlock(Block *block) {
+    uintptr_t start = (uintptr_t)block;
+    uintptr_t end = (uintptr_t)block->cells + block->cellSize * block->cellCount;
+    size_t chunks = (end - start + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    while((mapCount + chunks) * 2 > mapCapacity) growBlockMap();
+    for(uintptr_t chunk = start; chunk < end; chunk += BLOCK_SIZE) {
+        size_t slot = mapSlot(chunk);
+        mapKeys[slot] = chunk;
+        mapBlocks[slot] = block;
+        mapCount++;
+    }
+    if(start < heapLow) heapLow = start;
+    if(end > heapHigh) heapHigh = end;
+}
+
+// Rebuilds the block map from the block list after blocks have been freed
+void remapBlocks() {
+    memset(mapKeys, 0, mapCapacity * sizeof(uintptr_t));
+    mapCount = 0;
+    heapLow = UINTPTR_MAX;
+    heapHigh = 0;
+    for(Block *block = blocks; block != NULL; block = block->next) {
+        mapBlock(block);
+    }
+}
+
+// Mallocs a new block with room for count cells of the given size
+Block *newBlock(size_t cellSize, size_t count) {
+    size_t offset = (sizeof(Block) + GRANULE - 1) & ~(size_t)(GRANULE - 1);
+    void *memory;
+    if(posix_memalign(&memory, BLOCK_SIZE, offset + cellSize * count)) exit(1);
+    Block *block = (Block *)memory;
+    block->cellSize = cellSize;
+    block->cellCount = count;
+    block->cells = (char *)memory + offset;
+    block->next = blocks;
+    blocks = block;
+    stats.heapSize += offset + cellSize * count;
+    mapBlock(block);
+    return block;
+}
+
+// Adds a fresh block of the given size class and threads its cells onto the
+// free list for that class
+void growSizeClass(size_t cellSize) {
+    size_t offset = (sizeof(Block) + GRANULE - 1) & ~(size_t)(GRANULE - 1);
+    Block *block = newBlock(cellSize, (BLOCK_SIZE - offset) / cellSize);
+    Header **freeList = &freeLists[cellSize / GRANULE];
+    for(size_t i = block->cellCount; i > 0; i--) {
+        Header *cell = (Header *)(block->cells + (i - 1) * cellSize);
+        cell->size = cellSize;
+        cell->kind = FREE_OBJECT;
+        cell->marked = 0;
+        *(Header **)(cell + 1) = *freeList;
+        *freeList = cell;
+    }
+}
+
+// Takes a cell of the given size from the old generation
+Header *allocOld(size_t cellSize) {
+    if(cellSize > MAX_SMALL) return (Header *)newBlock(cellSize, 1)->cells;
+    Header **freeList = &freeLists[cellSize / GRANULE];
+    if(*freeList == NULL) growSizeClass(cellSize);
+    Header *header = *freeList;
+    *freeList = *(Header **)(header + 1);
+    return header;
+}
+
+// Returns the header of the live object containing the given address, or NULL
+// if the address isn't inside one
+Header *findObject(uintptr_t p) {
+    if(pageIndex((void *)p) >= 0) return findYoungObject(p);
+    if(p < heapLow || p >= heapHigh) return NULL;
+    uintptr_t chunk = p & ~(uintptr_t)(BLOCK_SIZE - 1);
+    size_t slot = mapSlot(chunk);
+    if(mapKeys[slot] == 0) return NULL;
+    Block *block = mapBlocks[slot];
+    if(p < (uintptr_t)block->cells) return NULL;
+    size_t index = (p - (uintptr_t)block->cells) / block->cellSize;
+    if(index >= block->cellCount) return NULL;
+    Header *header = (Header *)(block->cells + index * block->cellSize);
+    if(header->kind == FREE_OBJECT) return NULL;
+    return header;
+}
+
+// Marks the given object and queues it to have its children visited
+void shade(Header *header) {
+    if(header->marked) return;
+    header->marked = 1;
+    pushHeader(&grayStack, &grayCount, &grayCapacity, header);
+}
+
+// Copies the given nursery object into the old generation, leaving a
+// forwarding pointer behind, and returns the copy
+void *promote(Header *header) {
+    if(header->forwarded) return *(void **)(header + 1);
+    Header *copy = allocOld(header->size);
+    memcpy(copy, header, header->size);
+    copy->marked = 0;
+    copy->remembered = 0;
+    header->forwarded = 1;
+    *(void **)(header + 1) = copy + 1;
+    pushHeader(&grayStack, &grayCount, &grayCapacity, copy);
+    promotedSinceMajor += header->size;
+    stats.bytesPromoted += header->size;
+    return copy + 1;
+}
+
+// Visits a slot holding a pointer. A full collection marks what it points to;
+// a minor collection moves it out of the nursery and updates the slot.
+// Immediate integers aren't pointers at all and are skipped.
+void gcVisit(void **slot) {
+    void *p = *slot;
+    if(isFixnum(p)) return;
+    if(mode == MINOR_COLLECTION) {
+        if(!isYoung(p)) return;
+        Header *header = headerOf(p);
+        if(pages[pageIndex(p)].pinned) shade(header);
+        else *slot = promote(header);
+    } else {
+        Header *header = findObject((uintptr_t)p);
+        if(header != NULL) shade(header);
+    }
+}
+
+// Visits a word from the C stack that may or may not be a pointer. Nursery
+// objects it points to pin their page, since the word can't be updated.
+void visitAmbiguous(void *p) {
+    if(mode == MINOR_COLLECTION && !isYoung(p)) return;
+    Header *header = findObject((uintptr_t)p);
+    if(header == NULL) return;
+    if(mode == MINOR_COLLECTION) pages[pageIndex(p)].pinned = true;
+    shade(header);
+}
+
+// Visits every pointer in the given object
+void traceObject(Header *header) {
+    if(header->kind == VALUE_OBJECT) {
+        Value *value = (Value *)(header + 1);
+        if(value->type == CONS_TYPE) {
+            gcVisit((void **)&value->c.car);
+            gcVisit((void **)&value->c.cdr);
+        } else if(value->type == BINDING_TYPE) {
+            gcVisit((void **)&value->b.var);
+            gcVisit((void **)&value->b.val);
+        } else if(value->type == CLOSURE_TYPE) {
+            gcVisit((void **)&value->cl.code);
+            gcVisit((void **)&value->cl.frame);
+        } else if(value->type == LOCAL_TYPE) {
+            gcVisit((void **)&value->a.next);
+        } else if(value->type == BODY_TYPE) {
+            gcVisit((void **)&value->body.expr);
+        } else if(value->type == BIGNUM_TYPE) {
+            gcVisit((void **)&value->big.digits);
+        } else if(value->type == STR_TYPE) {
+            gcVisit((void **)&value->str.chars);
+        } else if(value->type == STRING_PORT_TYPE) {
+            gcVisit((void **)&value->port.chars);
+        } else if(value->type == VECTOR_TYPE) {
+            gcVisit((void **)&value->vec.items);
+        } else if(value->type == HASH_TABLE_TYPE) {
+            gcVisit((void **)&value->ht.slots);
+        }
+    } else if(header->kind == FRAME_OBJECT) {
+        Frame *frame = (Frame *)(header + 1);
+        gcVisit((void **)&frame->parent);
+        for(int i = 0; i < frame->size; i++) gcVisit((void **)&frame->slots[i]);
+    } else if(header->kind == CODE_OBJECT) {
+        Code *code = (Code *)(header + 1);
+        for(int i = 0; i < code->constantCount; i++) gcVisit((void **)&code->constants[i]);
+    } else if(header->kind == ARRAY_OBJECT) {
+        // the slots past the ones asked for that fill out the cell are NULL
+        Value **items = (Value **)(header + 1);
+        size_t count = (header->size - sizeof(Header)) / sizeof(Value *);
+        for(size_t i = 0; i < count; i++) gcVisit((void **)&items[i]);
+    }
+}
+
+// Visits the children of every gray object, using an explicit stack so that
+// long lists don't recurse on the C stack
+void drainGrayStack() {
+    while(grayCount > 0) traceObject(grayStack[--grayCount]);
+}
+
+// Visits every word in the given range that could be a pointer into the heap
+void scanRange(void *low, void *high) {
+    uintptr_t start = ((uintptr_t)low + sizeof(void *) - 1) & ~(uintptr_t)(sizeof(void *) - 1);
+    for(void **p = (void **)start; (void *)p < high; p++) visitAmbiguous(*p);
+}
+
+// Scans from this function's frame up to the base of the stack, which covers
+// the registers its caller spilled
+void __attribute__((noinline)) scanStackFrom() {
+    scanRange(__builtin_frame_address(0), stackBase);
+}
+
+// Spills the callee saved registers onto the stack and scans the whole stack,
+// since any local variable in the evaluator may be holding an object
+void __attribute__((noinline)) scanStack() {
+    jmp_buf registers;
+    __builtin_unwind_init();
+    setjmp(registers);
+    scanStackFrom();
+    __asm__ volatile("" : : "r"(&registers) : "memory");
+}
+
+// Returns whether p points into the frame stack
+bool isOnFrameStack(void *p) {
+    return (uintptr_t)p - (uintptr_t)frameStack < FRAME_STACK_SIZE;
+}
+
+// Visits the pointers in every frame on the frame stack, or during a minor
+// collection in those from gcFrameLow up. The ones below it only point to old
+// objects, which a minor collection doesn't move.
+void visitFrameStack() {
+    char *p = mode == MINOR_COLLECTION ? gcFrameLow : frameStack;
+    while(p < (char *)gcFrameTop) {
+        Frame *frame = (Frame *)p;
+        gcVisit((void **)&frame->parent);
+        for(int i = 0; i < frame->size; i++) gcVisit((void **)&frame->slots[i]);
+        p += sizeof(Frame) + frame->size * sizeof(Value *);
+    }
+    gcFrameLow = gcFrameTop;
+}
+
+// Visits every root: the stack, the frame stack, the registered root sets,
+// and during a minor collection the remembered set
+void visitRoots() {
+    scanStack();
+    visitFrameStack();
+    for(int i = 0; i < rootSetCount; i++) rootSets[i]();
+    if(mode == MINOR_COLLECTION) {
+        for(size_t i = 0; i < rememberedCount; i++) {
+            rememberedSet[i]->remembered = 0;
+            traceObject(rememberedSet[i]);
+        }
+        rememberedCount = 0;
+    }
+}
+
+// Retires a pinned nursery page into the old generation. Objects in it that
+// weren't reached are dead and become free cells.
+void retirePage(int page) {
+    char *cur = pageStart(page);
+    while(cur < pages[page].top) {
+        Header *header = (Header *)cur;
+        if(header->marked) header->marked = 0;
+        else header->kind = FREE_OBJECT;
+        cur += header->size;
+    }
+    pages[page].pinned = false;
+    pages[page].old = true;
+    promotedSinceMajor += NURSERY_PAGE_SIZE;
+}
+
+// Returns the current time in milliseconds
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+// Records a pause that began at the given time in the stats
+void recordPause(double start) {
+    double pause = now() - start;
+    stats.totalPauseMs += pause;
+    if(pause > stats.maxPauseMs) stats.maxPauseMs = pause;
+}
+
+// Empties the nursery by promoting everything reachable into the old
+// generation. Its cost is proportional to the surviving objects rather than
+// to everything allocated since the last collection.
+void minorCollect() {
+    if(nursery == NULL) return;
+    double start = now();
+    if(currentPage >= 0) pages[currentPage].top = nurseryTop;
+    mode = MINOR_COLLECTION;
+    visitRoots();
+    drainGrayStack();
+    for(int i = 0; i < NURSERY_PAGES; i++) {
+        if(pages[i].old) continue;
+        if(pages[i].pinned) retirePage(i);
+        else resetPage(i);
+    }
+    currentPage = -1;
+    findNurseryPage(0);
+    mode = NO_COLLECTION;
+    stats.minorCollections++;
+    recordPause(start);
+}
+
+// Frees every unmarked object in the old generation blocks, clears the marks
+// on the rest, and gives empty blocks back to the system. Returns the number
+// of live bytes.
+size_t sweepBlocks() {
+    for(int i = 0; i < SIZE_CLASSES; i++) freeLists[i] = NULL;
+    Block **link = &blocks;
+    size_t live = 0;
+    bool freedBlock = false;
+    while(*link != NULL) {
+        Block *block = *link;
+        Header *freeCells = NULL;
+        Header *lastFree = NULL;
+        size_t used = 0;
+        for(size_t i = 0; i < block->cellCount; i++) {
+            Header *cell = (Header *)(block->cells + i * block->cellSize);
+            if(cell->kind != FREE_OBJECT && cell->marked) {
+                cell->marked = 0;
+                used++;
+                continue;
+            }
+            cell->kind = FREE_OBJECT;
+            *(Header **)(cell + 1) = freeCells;
+            if(freeCells == NULL) lastFree = cell;
+            freeCells = cell;
+        }
+        if(used == 0) {
+            *link = block->next;
+            stats.heapSize -= (block->cells - (char *)block) + block->cellSize * block->cellCount;
+            free(block);
+            freedBlock = true;
+            continue;
+        }
+        live += used * block->cellSize;
+        if(freeCells != NULL) {
+            Header **freeList = &freeLists[block->cellSize / GRANULE];
+            *(Header **)(lastFree + 1) = *freeList;
+            *freeList = freeCells;
+        }
+        link = &block->next;
+    }
+    if(freedBlock) remapBlocks();
+    return live;
+}
+
+// Frees the unmarked objects in retired nursery pages, and gives pages with
+// nothing left in them back to the nursery. Returns the number of live bytes.
+size_t sweepPages() {
+    size_t live = 0;
+    for(int i = 0; i < NURSERY_PAGES; i++) {
+        if(!pages[i].old) continue;
+        size_t used = 0;
+        char *cur = pageStart(i);
+        while(cur < pages[i].top) {
+            Header *header = (Header *)cur;
+            if(header->kind != FREE_OBJECT && header->marked) {
+                header->marked = 0;
+                used += header->size;
+            } else header->kind = FREE_OBJECT;
+            cur += header->size;
+        }
+        if(used == 0) resetPage(i);
+        live += used;
+    }
+    return live;
+}
+
+// Runs a full collection: a minor collection to empty the nursery followed by
+// a mark and sweep of the old generation
+void gcCollect() {
+    minorCollect();
+    double start = now();
+    mode = MAJOR_COLLECTION;
+    visitRoots();
+    drainGrayStack();
+    stats.bytesLive = sweepBlocks() + sweepPages();
+    mode = NO_COLLECTION;
+    if(nursery != NULL) findNurseryPage(0);
+
+    promotedSinceMajor = 0;
+    threshold = stats.bytesLive > MIN_THRESHOLD ? stats.bytesLive : MIN_THRESHOLD;
+    stats.collections++;
+    recordPause(start);
+}
+
+// Collects the nursery, and the whole heap too if enough has been promoted
+// since the last full collection
+void collectGarbage() {
+    if(promotedSinceMajor >= threshold) gcCollect();
+    else minorCollect();
+}
+
+// Allocates a zeroed object of the given kind. Small young objects go in the
+// nursery; big ones go straight into the old generation.
+void *allocObject(size_t size, objectKind kind, bool young) {
+    assert(kind != FREE_OBJECT);
+    assert(mode == NO_COLLECTION);
+    assert(size <= GC_MAX_SIZE);
+    size_t cellSize = (sizeof(Header) + size + GRANULE - 1) & ~(size_t)(GRANULE - 1);
+    if(cellSize < sizeof(Header) + sizeof(void *)) cellSize = sizeof(Header) + sizeof(void *);
+
+    Header *header = NULL;
+    // When every nursery page is pinned, allocate old until a full
+    // collection frees some of them
+    if(young && cellSize <= MAX_SMALL && nurseryTop != NULL) {
+        header = allocYoung(cellSize);
+        if(header == NULL) {
+            collectGarbage();
+            header = allocYoung(cellSize);
+        }
+    }
+    if(header == NULL) {
+        if(nursery != NULL && promotedSinceMajor >= threshold) gcCollect();
+        header = allocOld(cellSize);
+        promotedSinceMajor += cellSize;
+        // It may be handed young pointers before the next minor collection
+        // without going through the write barrier
+        header->remembered = 1;
+        pushHeader(&rememberedSet, &rememberedCount, &rememberedCapacity, header);
+    } else header->remembered = 0;
+    header->size = cellSize;
+    header->kind = kind;
+    header->marked = 0;
+    header->forwarded = 0;
+    memset(header + 1, 0, cellSize - sizeof(Header));
+
+    stats.bytesAllocated += cellSize;
+    stats.objectsAllocated++;
+    return header + 1;
+}
+
+// Allocates an object that starts out in the nursery if it is small
+void *gcAlloc(size_t size, objectKind kind) {
+    return allocObject(size, kind, true);
+}
+
+// Allocates an object in the old generation, where it is never moved
+void *gcAllocOld(size_t size, objectKind kind) {
+    return allocObject(size, kind, false);
+}
+
+// Allocates a zeroed Value owned by the collector
+Value *gcAllocValue() {
+    return (Value *)gcAlloc(sizeof(Value), VALUE_OBJECT);
+}
+
+// Allocates a Frame owned by the collector with the given number of slots
+Frame *gcAllocFrame(int size) {
+    assert(size >= 0);
+    Frame *frame = (Frame *)gcAlloc(sizeof(Frame) + size * sizeof(Value *), FRAME_OBJECT);
+    frame->size = size;
+    return frame;
+}
+
+// Allocates an array owned by the collector of the given number of Value
+// pointers
+Value **gcAllocArray(int count) {
+    assert(count >= 0);
+    return (Value **)gcAlloc(count * sizeof(Value *), ARRAY_OBJECT);
+}
+
+// Pushes a Frame with the given number of slots, all of them NULL, onto the
+// frame stack, or allocates it like gcAllocFrame if the frame stack is full
+Frame *gcPushFrame(int size) {
+    assert(size >= 0);
+    size_t bytes = sizeof(Frame) + size * sizeof(Value *);
+    if((char *)gcFrameTop + bytes > frameStack + FRAME_STACK_SIZE) return gcAllocFrame(size);
+    Frame *frame = (Frame *)gcFrameTop;
+    gcFrameTop = (char *)gcFrameTop + bytes;
+    memset(frame->slots, 0, size * sizeof(Value *));
+    frame->size = size;
+    return frame;
+}
+
+// Records that the given object now holds the given pointer. Old objects that
+// point into the nursery are remembered so that minor collections can treat
+// them as roots.
+void gcWriteBarrier(void *owner, void *value) {
+    if(!isYoung(value) || isYoung(owner) || isOnFrameStack(owner)) return;
+    Header *header = headerOf(owner);
+    if(header->remembered) return;
+    header->remembered = 1;
+    pushHeader(&rememberedSet, &rememberedCount, &rememberedCapacity, header);
+}
+
+// Registers a function that visits extra roots
+void gcAddRoots(void (*roots)()) {
+    assert(rootSetCount < MAX_ROOT_SETS);
+    rootSets[rootSetCount++] = roots;
+}
+
+// Sets up the nursery and the stack scanning up to the given address
+void gcInit(void *base) {
+    assert(sizeof(Header) <= GRANULE);
+    stackBase = base;
+    if(posix_memalign((void **)&nursery, NURSERY_PAGE_SIZE, NURSERY_SIZE)) exit(1);
+    for(int i = 0; i < NURSERY_PAGES; i++) resetPage(i);
+    findNurseryPage(0);
+    frameStack = malloc(FRAME_STACK_SIZE);
+    if(frameStack == NULL) exit(1);
+    gcFrameTop = frameStack;
+    gcFrameLow = frameStack;
+}
+
+// Fills in the given struct with the collector's counters
+void gcGetStats(GCStats *out) {
+    assert(out);
+    *out = stats;
+}
+
+// Prints the collector's counters to the given stream
+void gcPrintStats(FILE *out) {
+    fprintf(out, "gc: %lu minor and %lu major collections, %zu bytes in %lu objects "
+        "allocated, %zu bytes promoted, %zu bytes live, %zu byte heap, "
+        "%.3f ms total pause, %.3f ms max pause\n",
+        stats.minorCollections, stats.collections, stats.bytesAllocated,
+        stats.objectsAllocated, stats.bytesPromoted, stats.bytesLive,
+        stats.heapSize + (nursery ? NURSERY_SIZE : 0), stats.totalPauseMs,
+        stats.maxPauseMs);
+}
+
+// Frees every block owned by the collector, and the nursery
+void gcFreeAll() {
+    Block *cur = blocks;
+    Block *next;
+    while(cur != NULL) {
+        next = cur->next;
+        free(cur);
+        cur = next;
+    }
+    blocks = NULL;
+    for(int i = 0; i < SIZE_CLASSES; i++) freeLists[i] = NULL;
+    free(nursery);
+    free(mapKeys);
+    free(mapBlocks);
+    free(grayStack);
+    free(rememberedSet);
+    free(frameStack);
+    nursery = NULL;
+    frameStack = NULL;
+    gcFrameTop = NULL;
+    gcFrameLow = NULL;
+    currentPage = -1;
+    nurseryTop = nurseryLimit = NULL;
+    mapKeys = NULL;
+    mapBlocks = NULL;
+    grayStack = NULL;
+    rememberedSet = NULL;
+    mapCapacity = mapCount = 0;
+    grayCapacity = grayCount = 0;
+    rememberedCapacity = rememberedCount = 0;
+    stats.heapSize = 0;
+    heapLow = UINTPTR_MAX;
+    heapHigh = 0;
+}
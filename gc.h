@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "value.h"
+
+#ifndef _GC
+#define _GC
+
+struct Frame;
+
+// The kinds of objects the collector knows how to trace
+typedef enum {FREE_OBJECT,VALUE_OBJECT,FRAME_OBJECT,CODE_OBJECT,RAW_OBJECT,
+    ARRAY_OBJECT} objectKind;
+
+// The most bytes an object can hold, so that its size, rounded up and with
+// its header, fits in the 32 bit size field of the header
+#define GC_MAX_SIZE ((size_t)UINT32_MAX - 64)
+
+// Numbers describing the work the collector has done so far
+typedef struct GCStats GCStats;
+struct GCStats {
+    size_t bytesLive;
+    size_t bytesAllocated;
+    size_t bytesPromoted;
+    size_t heapSize;
+    unsigned long objectsAllocated;
+    unsigned long minorCollections;
+    unsigned long collections;
+    double totalPauseMs;
+    double maxPauseMs;
+};
+
+// Sets up the collector. stackBase is the highest address of the C stack that
+// should be scanned for pointers, normally the frame address of main.
+void gcInit(void *stackBase);
+
+// Allocates an object of the given kind that is reclaimed by the collector
+// once it is no longer reachable from the roots. The memory is zeroed. Small
+// objects start out in the nursery and are moved when they survive a minor
+// collection, unless the C stack points at them.
+void *gcAlloc(size_t size, objectKind kind);
+
+// Like gcAlloc, but the object goes straight to the old generation so its
+// address never changes
+void *gcAllocOld(size_t size, objectKind kind);
+
+// Allocates a zeroed Value owned by the collector
+Value *gcAllocValue();
+
+// Allocates a Frame owned by the collector with the given number of slots,
+// all of them NULL
+struct Frame *gcAllocFrame(int size);
+
+// Allocates an array owned by the collector of the given number of Value
+// pointers, all of them NULL
+Value **gcAllocArray(int count);
+
+// Frames that can't be reached once the function that made them returns go on
+// the frame stack instead of the heap. gcFrameTop is its top, and frames are
+// popped by setting it back to what it was before they were pushed.
+extern void *gcFrameTop;
+
+// Frames below gcFrameLow haven't been written since the last collection
+// visited them, so a minor collection skips them. Writes to frames on the
+// frame stack have no write barrier, so whatever writes them must first lower
+// gcFrameLow to the lowest frame it may write. Each collection raises it to
+// gcFrameTop after visiting the frame stack, before the other roots.
+extern void *gcFrameLow;
+
+// Pushes a Frame with the given number of slots, all of them NULL, onto the
+// frame stack, where it's never moved and its slots are roots until it's
+// popped. If the frame stack is full, the frame comes from gcAllocFrame.
+struct Frame *gcPushFrame(int size);
+
+// Registers a function that visits extra roots by calling gcVisit on the
+// address of each variable holding one. The C stack and registers are always
+// treated as roots.
+void gcAddRoots(void (*roots)());
+
+// Visits the given slot holding a pointer to an object during a collection.
+// The collector may move the object and update the slot. Pointers that aren't
+// into the collected heap are ignored.
+void gcVisit(void **slot);
+
+// Must be called after storing value into a field of owner, unless owner was
+// allocated after value or nothing has been allocated since owner was. It
+// lets minor collections find old objects that point at young ones.
+void gcWriteBarrier(void *owner, void *value);
+
+// Runs a full collection immediately
+void gcCollect();
+
+// Fills in stats with the collector's counters
+void gcGetStats(GCStats *stats);
+
+// Prints the collector's counters to the given stream
+void gcPrintStats(FILE *out);
+
+// Frees every object and block owned by the collector
+void gcFreeAll();
+
+#endif
@@ -0,0 +1,326 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "gc.h"
+#include "symbol.h"
+#include "number.h"
+#include "text.h"
+#include "hashtable.h"
+
+// The most parts of a list or vector that an equal? hash looks at
+#define HASH_BUDGET 16
+
+// The number of pairs of values isEqual has left to compare that it keeps on
+// the C stack before it moves them to the heap
+#define EQUAL_STACK_SIZE 32
+
+// The next identity number to give a Value that is hashed by eq?
+uint32_t nextIdentity = 0;
+
+// Returns whether the given values are the same object
+bool isEq(Value *a, Value *b) {
+    return a == b;
+}
+
+// Returns whether the given values are eq?, or numbers of the same exactness
+// with the same value. Doubles are compared bit for bit, so that eqv? agrees
+// with their hash.
+bool isEqv(Value *a, Value *b) {
+    if(a == b) return true;
+    valueType type = typeOf(a);
+    if(type != typeOf(b)) return false;
+    if(type == BIGNUM_TYPE) return numberCompare(a, b) == 0;
+    if(type == DOUBLE_TYPE) return !memcmp(&a->d, &b->d, sizeof(double));
+    return false;
+}
+
+// Returns whether the given values, which aren't both pairs, could be
+// equal?: they're eqv?, strings with the same characters, or vectors of the
+// same length, whose elements still need comparing
+bool sameShape(Value *a, Value *b) {
+    valueType type = typeOf(a);
+    if(type != typeOf(b)) return false;
+    if(type == STR_TYPE) {
+        return a->str.length == b->str.length &&
+            !memcmp(stringChars(a), stringChars(b), a->str.length);
+    }
+    if(type == VECTOR_TYPE) return a->vec.length == b->vec.length;
+    return isEqv(a, b);
+}
+
+// Returns whether the given values are eqv?, or lists, vectors or strings
+// whose elements are equal?. Pairs of parts still to compare are kept on a
+// stack of their own, so no amount of nesting uses up the C stack.
+bool isEqual(Value *a, Value *b) {
+    Value *local[2 * EQUAL_STACK_SIZE];
+    Value **stack = local;
+    int depth = 0;
+    int capacity = 2 * EQUAL_STACK_SIZE;
+    bool equal = true;
+    for(;;) {
+        if(typeOf(a) == CONS_TYPE && typeOf(b) == CONS_TYPE) {
+            if(depth == capacity) stack = growNestingStack(stack, local, &capacity);
+            stack[depth++] = cdr(a);
+            stack[depth++] = cdr(b);
+            a = car(a);
+            b = car(b);
+            continue;
+        }
+        if(!sameShape(a, b)) {
+            equal = false;
+            break;
+        }
+        if(typeOf(a) == VECTOR_TYPE && a != b) {
+            for(int i = a->vec.length - 1; i >= 0; i--) {
+                if(depth == capacity) stack = growNestingStack(stack, local, &capacity);
+                stack[depth++] = a->vec.items[i];
+                stack[depth++] = b->vec.items[i];
+            }
+        }
+        if(depth == 0) break;
+        b = stack[--depth];
+        a = stack[--depth];
+    }
+    if(stack != local) free(stack);
+    return equal;
+}
+
+// Spreads the bits of the given number over a 32 bit hash
+uint32_t mixHash(uint64_t n) {
+    return (n * 11400714819323198485ull) >> 32;
+}
+
+// Returns the eq? hash of the given value. The shared null, void and boolean
+// values are hashed by type, and everything else that isn't a fixnum by an
+// identity number that it's given the first time it's hashed.
+uint32_t hashIdentity(Value *value) {
+    if(isFixnum(value)) return mixHash(fixnumValue(value));
+    valueType type = value->type;
+    if(type == NULL_TYPE || type == VOID_TYPE || type == BOOL_TYPE) {
+        return mixHash(type * 2 + (type == BOOL_TYPE && value->i));
+    }
+    if(value->hash == 0) {
+        if(++nextIdentity == 0) nextIdentity = 1;
+        value->hash = nextIdentity;
+    }
+    return mixHash(value->hash);
+}
+
+// Returns the eqv? hash of the given value: numbers are hashed by value
+uint32_t hashNumber(Value *value) {
+    valueType type = typeOf(value);
+    if(type == DOUBLE_TYPE) {
+        uint64_t bits;
+        memcpy(&bits, &value->d, sizeof(double));
+        return mixHash(bits);
+    }
+    if(type == BIGNUM_TYPE) {
+        uint32_t hash = mixHash(value->big.sign);
+        for(int i = 0; i < value->big.length; i++) {
+            hash = mixHash(hash ^ value->big.digits[i]);
+        }
+        return hash;
+    }
+    return hashIdentity(value);
+}
+
+// Returns the equal? hash of the given value, looking at no more than budget
+// parts of it in all
+uint32_t hashStructure(Value *value, int *budget) {
+    uint32_t hash = 0;
+    while(typeOf(value) == CONS_TYPE && *budget > 0) {
+        (*budget)--;
+        hash = mixHash(hash ^ hashStructure(car(value), budget));
+        value = cdr(value);
+    }
+    valueType type = typeOf(value);
+    if(type == CONS_TYPE) return hash;
+    if(type == STR_TYPE) {
+        return mixHash(hash ^ hashName(stringChars(value), value->str.length));
+    }
+    if(type == VECTOR_TYPE) {
+        hash ^= mixHash(value->vec.length);
+        for(int i = 0; i < value->vec.length && *budget > 0; i++) {
+            (*budget)--;
+            hash = mixHash(hash ^ hashStructure(value->vec.items[i], budget));
+        }
+        return hash;
+    }
+    return mixHash(hash ^ hashNumber(value));
+}
+
+// Returns a hash of the given value that is the same for any two values that
+// the given equivalence says are the same
+uint32_t hashValue(Value *value, equivalence test) {
+    assert(value);
+    if(test == EQ_TEST) return hashIdentity(value);
+    if(test == EQV_TEST) return hashNumber(value);
+    int budget = HASH_BUDGET;
+    return hashStructure(value, &budget);
+}
+
+// Returns whether the given keys are the same by the given equivalence
+bool sameKey(Value *a, Value *b, equivalence test) {
+    if(test == EQ_TEST) return isEq(a, b);
+    if(test == EQV_TEST) return isEqv(a, b);
+    return isEqual(a, b);
+}
+
+// Creates an empty hash table with no slots, which get allocated by the
+// first store
+Value *makeHashTable(equivalence test) {
+    Value *table = gcAllocValue();
+    table->type = HASH_TABLE_TYPE;
+    table->ht.count = 0;
+    table->ht.capacity = 0;
+    table->ht.test = test;
+    table->ht.slots = NULL;
+    return table;
+}
+
+// Returns the hash that the given key is stored under in the table, which is
+// never 0
+uint32_t keyHash(Value *table, Value *key) {
+    uint32_t hash = hashValue(key, table->ht.test);
+    return hash ? hash : 1;
+}
+
+// Returns the hash stored in the given slot, which holds an entry. Stored
+// hashes are never 0, so a NULL hash marks an empty slot.
+uint32_t slotHash(Value *table, int slot) {
+    return fixnumValue(table->ht.slots[3 * slot]);
+}
+
+// Returns how far the given slot, which holds an entry, is from the slot its
+// hash starts probing at
+int probeDistance(Value *table, int slot) {
+    int mask = table->ht.capacity - 1;
+    return (slot - (int)(slotHash(table, slot) & mask)) & mask;
+}
+
+// Returns the slot holding the entry for the given key, which has the given
+// hash, or -1 if there isn't one. The search stops at an empty slot, or at
+// an entry closer to its starting slot than the key would be to its own,
+// since Robin Hood insertion would have put the key there.
+int findSlot(Value *table, Value *key, uint32_t hash) {
+    if(table->ht.count == 0) return -1;
+    int mask = table->ht.capacity - 1;
+    int slot = hash & mask;
+    for(int distance = 0; ; distance++, slot = (slot + 1) & mask) {
+        if(table->ht.slots[3 * slot] == NULL || probeDistance(table, slot) < distance) {
+            return -1;
+        }
+        if(slotHash(table, slot) == hash &&
+            sameKey(table->ht.slots[3 * slot + 1], key, table->ht.test)) return slot;
+    }
+}
+
+// Puts an entry for a key that isn't in the table into it, which must have
+// room. Each entry passed on the way that is closer to its starting slot
+// than the one being placed gives up its slot to it and is placed further on
+// in turn.
+void insertEntry(Value *table, Value *hash, Value *key, Value *value) {
+    int mask = table->ht.capacity - 1;
+    Value **slots = table->ht.slots;
+    int slot = fixnumValue(hash) & mask;
+    for(int distance = 0; ; distance++, slot = (slot + 1) & mask) {
+        if(slots[3 * slot] == NULL) break;
+        int other = probeDistance(table, slot);
+        if(other < distance) {
+            Value *entry[3] = {hash, key, value};
+            hash = slots[3 * slot];
+            key = slots[3 * slot + 1];
+            value = slots[3 * slot + 2];
+            memcpy(&slots[3 * slot], entry, sizeof(entry));
+            distance = other;
+        }
+    }
+    slots[3 * slot] = hash;
+    slots[3 * slot + 1] = key;
+    slots[3 * slot + 2] = value;
+    gcWriteBarrier(slots, key);
+    gcWriteBarrier(slots, value);
+}
+
+// Doubles the number of slots of the table, or gives it its first 8, and
+// puts every entry back in
+void growHashTable(Value *table) {
+    int oldCapacity = table->ht.capacity;
+    int capacity = oldCapacity ? oldCapacity * 2 : 8;
+    Value **slots = gcAllocArray(3 * capacity);
+    Value **old = table->ht.slots;
+    table->ht.slots = slots;
+    table->ht.capacity = capacity;
+    gcWriteBarrier(table, slots);
+    for(int i = 0; i < oldCapacity; i++) {
+        if(old[3 * i] != NULL) insertEntry(table, old[3 * i], old[3 * i + 1], old[3 * i + 2]);
+    }
+}
+
+// Returns the value stored under the given key, or NULL if there is none
+Value *hashTableRef(Value *table, Value *key) {
+    assert(typeOf(table) == HASH_TABLE_TYPE);
+    int slot = findSlot(table, key, keyHash(table, key));
+    return slot < 0 ? NULL : table->ht.slots[3 * slot + 2];
+}
+
+// Stores the given value under the given key. The table grows before it's
+// three quarters full.
+void hashTableSet(Value *table, Value *key, Value *value) {
+    assert(typeOf(table) == HASH_TABLE_TYPE);
+    uint32_t hash = keyHash(table, key);
+    int slot = findSlot(table, key, hash);
+    if(slot >= 0) {
+        table->ht.slots[3 * slot + 2] = value;
+        gcWriteBarrier(table->ht.slots, value);
+        return;
+    }
+    if((table->ht.count + 1) * 4 > table->ht.capacity * 3) growHashTable(table);
+    insertEntry(table, makeFixnum(hash), key, value);
+    table->ht.count++;
+}
+
+// Removes the entry for the given key, if there is one, and moves each entry
+// after it that isn't in its starting slot back by one, so that no probe
+// stops short of them
+void hashTableDelete(Value *table, Value *key) {
+    assert(typeOf(table) == HASH_TABLE_TYPE);
+    int slot = findSlot(table, key, keyHash(table, key));
+    if(slot < 0) return;
+    int mask = table->ht.capacity - 1;
+    Value **slots = table->ht.slots;
+    int next = (slot + 1) & mask;
+    while(slots[3 * next] != NULL && probeDistance(table, next) > 0) {
+        memcpy(&slots[3 * slot], &slots[3 * next], 3 * sizeof(Value *));
+        slot = next;
+        next = (next + 1) & mask;
+    }
+    memset(&slots[3 * slot], 0, 3 * sizeof(Value *));
+    table->ht.count--;
+}
+
+// Returns the first slot from the given one that holds an entry, or -1
+int hashTableNext(Value *table, int slot) {
+    assert(typeOf(table) == HASH_TABLE_TYPE);
+    while(slot < (int)table->ht.capacity) {
+        if(table->ht.slots[3 * slot] != NULL) return slot;
+        slot++;
+    }
+    return -1;
+}
+
+// Returns the key of the entry in the given slot
+Value *hashTableKey(Value *table, int slot) {
+    assert(table->ht.slots[3 * slot] != NULL);
+    return table->ht.slots[3 * slot + 1];
+}
+
+// Returns the value of the entry in the given slot
+Value *hashTableValue(Value *table, int slot) {
+    assert(table->ht.slots[3 * slot] != NULL);
+    return table->ht.slots[3 * slot + 2];
+}
@@ -0,0 +1,56 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "value.h"
+
+#ifndef _HASHTABLE
+#define _HASHTABLE
+
+// The equivalences that a hash table can compare its keys with, from the
+// finest to the coarsest
+typedef enum {EQ_TEST,EQV_TEST,EQUAL_TEST} equivalence;
+
+// Returns whether the given values are the same object. Fixnums with the same
+// value are the same object.
+bool isEq(Value *a, Value *b);
+
+// Returns whether the given values are eq?, or numbers of the same exactness
+// with the same value
+bool isEqv(Value *a, Value *b);
+
+// Returns whether the given values are eqv?, or lists, vectors or strings
+// whose elements are equal?
+bool isEqual(Value *a, Value *b);
+
+// Returns a hash of the given value that is the same for any two values that
+// the given equivalence says are the same. Objects are hashed by an identity
+// number kept in their Value rather than by address, since the collector
+// moves them. Only a bounded part of a big structure is hashed.
+uint32_t hashValue(Value *value, equivalence test);
+
+// Creates an empty HASH_TABLE_TYPE Value that compares its keys with the
+// given equivalence. Entries are kept by open addressing with Robin Hood
+// probing in one array of (hash, key, value) triples.
+Value *makeHashTable(equivalence test);
+
+// Returns the value stored under the given key, or NULL if there is none
+Value *hashTableRef(Value *table, Value *key);
+
+// Stores the given value under the given key, replacing any value already
+// stored under it
+void hashTableSet(Value *table, Value *key, Value *value);
+
+// Removes the entry for the given key, if there is one
+void hashTableDelete(Value *table, Value *key);
+
+// Returns the first slot of the table from the given one that holds an entry,
+// or -1 if there are no more. Allocating doesn't change which slots hold
+// entries, but the entries have to be read again through the table.
+int hashTableNext(Value *table, int slot);
+
+// Returns the key of the entry in the given slot
+Value *hashTableKey(Value *table, int slot);
+
+// Returns the value of the entry in the given slot
+Value *hashTableValue(Value *table, int slot);
+
+#endif
@@ -1,872 +1,665 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <assert.h>
-#include <string.h>
-#include <stdarg.h>
-#include "value.h"
-#include "linkedlist.h"
-#include "talloc.h"
-#include "interpreter.h"
-
-// Helper function to print error codes and exit the program
-void evalError(int errorCode) {
-    if(errorCode == 1) printf("\'if\' requires 3 arguments");
-    else if(errorCode == 2) printf("\'let\' can only assign expressions to symbols");
-    else if(errorCode == 3) printf("Function name must be a symbol");
-    else if(errorCode == 4) printf("Symbol undefined");
-    else if(errorCode == 5) printf("\'let\' requires a list of tuples as the first argument");
-    else if(errorCode == 6) printf("\'let\' requires 2 arguments");
-    else if(errorCode == 7) printf("Evaluation error");
-    else if(errorCode == 8) printf("\'quote\' requires one argument");
-    else if(errorCode == 9) printf("\'define\' requires two arguments");
-    else if(errorCode == 10) printf("\'define\' can only assign expressions to symbols");
-    else if(errorCode == 11) printf("\'lambda\' requires two arguments");
-    else if(errorCode == 12) printf("The first argument of \'lambda\' must be a list of arguments");
-    else if(errorCode == 13) printf("All arguments to \'+\' must evaluate to numbers");
-    else if(errorCode == 14) printf("Not enough arguments provided");
-    else if(errorCode == 15) printf("Too many arguments provided");
-    else if(errorCode == 16) printf("\'null?\' requires one argument");
-    else if(errorCode == 17) printf("\'car\' requires one argument");
-    else if(errorCode == 18) printf("\'cdr\' requires one argument");
-    else if(errorCode == 19) printf("\'cons\' requires two arguments");
-    else if(errorCode == 20) printf("\'car\' requires a list as an argument");
-    else if(errorCode == 21) printf("\'cdr\' requires a list as an argument");
-    else if(errorCode == 22) printf("\'zero?\' requires one argument");
-    else if(errorCode == 23) printf("\'zero?\' requires a number as an argument");
-    else if(errorCode == 24) printf("\'and\' requires 2 arguments");
-    else if(errorCode == 25) printf("\'and\' requires booleans as arguments");
-    else if(errorCode == 26) printf("\'or\' requires 2 arguments");
-    else if(errorCode == 27) printf("\'or\' requires booleans as arguments");
-    else if(errorCode == 28) printf("\'cond\' requires tuples where the first item evaluates to a boolean as arguments");
-    else if(errorCode == 29) printf("\'/\' requires two numbers as arguments");
-    else if(errorCode == 30) printf("Division by zero");
-    else if(errorCode == 31) printf("All arguments to \'*\' must evaluate to numbers");
-    else if(errorCode == 32) printf("\'modulo\' requires two integer arguments");
-    else if(errorCode == 33) printf("\'<\' requires two numerical arguments");
-    else if(errorCode == 34) printf("\'>\' requires two numerical arguments");
-    else if(errorCode == 35) printf("\'=\' requires two numerical arguments");
-    else if(errorCode == 36) printf("\'<=\' requires two numerical arguments");
-    else if(errorCode == 37) printf("\'>=\' requires two numerical arguments");
-    else printf("Evaluation error");
-    printf("\n");
-    texit(errorCode);
-}
-
-// Evaluates an if expression
-// Causes an evaluation error if there are not two arguments
-Value *evalIf(Value *args, Frame *frame) {
-    // error checks
-    assert(args);
-    assert(frame);
-    if(isNull(args)) evalError(1);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 3) evalError(1);
-
-    Value *cond = car(args);
-    Value *ifTrue = car(cdr(args));
-    Value *ifFalse = car(cdr(cdr(args)));
-    Value *result = eval(cond, frame);
-    if(result->type != BOOL_TYPE || !(result->i)) return eval(ifFalse, frame);
-    else return eval(ifTrue, frame);
-}
-
-// Evaluates a let expression
-// Causes an evaluation error if there's not two arguments,
-//      or if the first parameter is not a list of tuples where
-//      the first value in each tuple is a valid variable name
-Value *evalLet(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    if(isNull(args)) evalError(6);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(6);
-
-    Value *bindings = car(args);
-    Value *expr = car(cdr(args));
-    Value *curBinding;
-    Value *bindingsList = makeNull();
-    while(!isNull(bindings)) {
-        if(bindings->type != CONS_TYPE) evalError(5);
-        curBinding = car(bindings);
-        if(curBinding->type != CONS_TYPE) evalError(5);
-        if(length(curBinding) != 2) evalError(5);
-        Value *var = car(curBinding);
-        if(var->type != SYMBOL_TYPE) evalError(2);
-        Value *val = eval(car(cdr(curBinding)), frame);
-        bindingsList = cons(makeBinding(var, val), bindingsList);
-        bindings = cdr(bindings);
-    }
-    Frame *newFrame = (Frame *)talloc(sizeof(Frame));
-    newFrame->parent = frame;
-    newFrame->bindings = bindingsList;
-    return eval(expr, newFrame);
-}
-
-// Evaluates a let* expression (like let, but evaluates left to right and
-//      allows for linear dependency in the parameters)
-// Causes an evaluation error if there's not two arguments,
-//      or if the first parameter is not a list of tuples where
-//      the first value in each tuple is a valid variable name
-Value *evalLetStar(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    if(isNull(args)) evalError(6);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(6);
-
-    Value *bindings = car(args);
-    Value *expr = car(cdr(args));
-    Value *curBinding;
-    Value *bindingsList = makeNull();
-    Frame *newFrame = (Frame *)talloc(sizeof(Frame));
-    newFrame->parent = frame;
-    while(!isNull(bindings)) {
-        if(bindings->type != CONS_TYPE) evalError(5);
-        curBinding = car(bindings);
-        if(curBinding->type != CONS_TYPE) evalError(5);
-        if(length(curBinding) != 2) evalError(5);
-        Value *var = car(curBinding);
-        if(var->type != SYMBOL_TYPE) evalError(2);
-        Value *val = eval(car(cdr(curBinding)), newFrame);
-        bindingsList = cons(makeBinding(var, val), bindingsList);
-        newFrame->bindings = bindingsList;
-        bindings = cdr(bindings);
-    }
-    return eval(expr, newFrame);
-}
-
-// Evaluates a letrec expression
-// Causes an evaluation error if there's not two arguments,
-//      or if the first parameter is not a list of tuples where
-//      the first value in each tuple is a valid variable name
-Value *evalLetRec(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    if(isNull(args)) evalError(6);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(6);
-
-    Value *bindings = car(args);
-    Value *expr = car(cdr(args));
-    Value *curBinding;
-    Value *bindingsList = makeNull();
-    Value *values = makeNull();
-    while(!isNull(bindings)) {
-        if(bindings->type != CONS_TYPE) evalError(5);
-        curBinding = car(bindings);
-        if(curBinding->type != CONS_TYPE) evalError(5);
-        if(length(curBinding) != 2) evalError(5);
-        Value *var = car(curBinding);
-        if(var->type != SYMBOL_TYPE) evalError(2);
-        values = cons(car(cdr(curBinding)), values);
-        Value *val = (Value *)talloc(sizeof(Value));
-        val->type = BOOL_TYPE;
-        val->i = false;
-        bindingsList = cons(makeBinding(var, val), bindingsList);
-        bindings = cdr(bindings);
-    }
-    Frame *newFrame = (Frame *)talloc(sizeof(Frame));
-    newFrame->parent = frame;
-    newFrame->bindings = bindingsList;
-    curBinding = newFrame->bindings;
-    while(!isNull(values)) {
-        car(curBinding)->b.val = eval(car(values), newFrame);
-        curBinding = cdr(curBinding);
-        values = cdr(values);
-    }
-    return eval(expr, newFrame);
-}
-
-// Evaluates a quote expression
-// Causes an evaluation error if there's not one argument
-Value *evalQuote(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(8);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 1) evalError(8);
-
-    return car(args);
-}
-
-// Evaluates a define expression
-// Causes an evaluation error if there's not two arguments,
-//      or if the first argument is not a valid variable name
-Value *evalDefine(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    if(isNull(args)) evalError(9);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(9);
-
-    Value *var = car(args);
-    if(var->type != SYMBOL_TYPE) evalError(10);
-    Value *val = eval(car(cdr(args)), frame);
-    Value *binding = makeBinding(var, val);
-    frame->bindings = cons(binding, frame->bindings);
-    return makeVoid();
-}
-
-// Looks up the given symbol in the given frame and its parents and changes
-//      its value to the given new value
-// Throws an evaluation if the symbol doesn't exist
-void changeSymbol(Value *symbol, Value *value, Frame *frame) {
-    // error checking
-    assert(symbol);
-    assert(frame);
-    assert(symbol->type == SYMBOL_TYPE);
-
-    Frame *curFrame = frame;
-    while(curFrame != NULL) {
-        Value *curBinding = curFrame->bindings;
-        while(!isNull(curBinding)) {
-            if(!strcmp(symbol->s, var(car(curBinding))->s)) {
-                car(curBinding)->b.val = value;
-                return;
-            }
-            curBinding = cdr(curBinding);
-        }
-        curFrame = curFrame->parent;
-    }
-    evalError(4);
-}
-
-// Evaluates a set! expression
-// Causes an evaluation error if there's not two arguments,
-//      or if the first argument is not a valid variable name
-Value *evalSet(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    if(isNull(args)) evalError(9);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(9);
-
-    Value *var = car(args);
-    if(var->type != SYMBOL_TYPE) evalError(10);
-    Value *val = eval(car(cdr(args)), frame);
-    changeSymbol(var, val, frame);
-    return makeVoid();
-}
-
-// Evaluates a lambda expression
-// Causes an evaluation error if there's not two arguments,
-//      or if the second argument is not a list of parameters
-Value *evalLambda(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    if(isNull(args)) evalError(11);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(11);
-
-    Value *params = car(args);
-    if(params->type != CONS_TYPE && !isNull(params)) evalError(12);
-    Value *code = car(cdr(args));
-    return makeClosure(params, code, frame);
-}
-
-// Evaluates a begin expression
-Value *evalBegin(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    if(isNull(args)) return makeVoid();
-    assert(args->type == CONS_TYPE);
-
-    Value *cur = args;
-    while(!isNull(cdr(cur))) {
-        eval(car(cur), frame);
-        cur = cdr(cur);
-    }
-    return eval(car(cur), frame);
-}
-
-// Evaluates a cond expression
-// Causes an evaluation error if the arguments are not lists
-//      of length 2, or if the first argument of those lists
-//      is not a boolean (or else or #t for the last argument)
-Value *evalCond(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    if(isNull(args)) return makeVoid();
-    assert(args->type == CONS_TYPE);
-
-    Value *cur = args;
-    Value *cond;
-    while(!isNull(cdr(cur))) {
-        if(car(cur)->type != CONS_TYPE) evalError(28);
-        if(length(car(cur)) != 2) evalError(28);
-        cond = eval(car(car(cur)), frame);
-        if(cond->type != BOOL_TYPE) evalError(28);
-        if(cond->i) return eval(car(cdr(car(cur))), frame);
-        cur = cdr(cur);
-    }
-    if(car(cur)->type == BOOL_TYPE && car(cur)->i) return car(cur);
-    if(car(cur)->type != CONS_TYPE) evalError(28);
-    if(length(car(cur)) != 2) evalError(28);
-    if(!strcmp(car(car(cur))->s, "else")) return eval(car(cdr(car(cur))), frame);
-    cond = eval(car(car(cur)), frame);
-    if(cond->type != BOOL_TYPE) evalError(28);
-    if(cond->i) return eval(car(cdr(car(cur))), frame);
-    else return makeVoid();
-}
-
-// Evaluates an and expression
-// Causes an evaluation error if there's not two arguments,
-//      or if the arguments aren't booleans
-Value *evalAnd(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    if(isNull(args)) evalError(24);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(24);
-
-    Value *cur = args;
-    Value *cond;
-    while(!isNull(cur)) {
-        cond = eval(car(cur), frame);
-        if(cond->type != BOOL_TYPE) evalError(25);
-        if(!(cond->i)) return cond;
-        cur = cdr(cur);
-    }
-    return cond;
-}
-
-// Evaluates an or expression
-// Causes an evaluation error if there's not two arguments,
-//      or if the arguments aren't booleans
-Value *evalOr(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    if(isNull(args)) evalError(26);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(26);
-
-    Value *cur = args;
-    Value *cond;
-    while(!isNull(cur)) {
-        cond = eval(car(cur), frame);
-        if(cond->type != BOOL_TYPE) evalError(27);
-        if(cond->i) return cond;
-        cur = cdr(cur);
-    }
-    return cond;
-}
-
-// Evaluates a + expression
-// Causes an evaluation error if any of the arguments are not numbers
-Value *primitiveAdd(Value *args) {
-    // error checking
-    assert(args);
-    assert(args->type == CONS_TYPE || isNull(args));
-
-    Value *result = (Value *)talloc(sizeof(Value));
-    result->type = DOUBLE_TYPE;
-    result->d = 0;
-    if(length(args) == 0) return result;
-    Value *cur = args;
-    while(!isNull(cur)) {
-        if(car(cur)->type == INT_TYPE) result->d += (car(cur))->i;
-        else if(car(cur)->type == DOUBLE_TYPE) result->d += (car(cur))->d;
-        else evalError(13);
-        cur = cdr(cur);
-    }
-    return result;
-}
-
-// Evaluates a * expression
-// Causes an evaluation error if any of the arguments are not numbers
-Value *primitiveMultiply(Value *args) {
-    // error checking
-    assert(args);
-    assert(args->type == CONS_TYPE || isNull(args));
-
-    Value *result = (Value *)talloc(sizeof(Value));
-    result->type = DOUBLE_TYPE;
-    result->d = 0;
-    if(length(args) == 0) return result;
-    result->d = 1;
-    Value *cur = args;
-    while(!isNull(cur)) {
-        if(car(cur)->type == INT_TYPE) result->d *= (car(cur))->i;
-        else if(car(cur)->type == DOUBLE_TYPE) result->d *= (car(cur))->d;
-        else evalError(31);
-        cur = cdr(cur);
-    }
-    return result;
-}
-
-// Evaluates a / expression
-// Causes an evaluation error if there aren't two arguments,
-//      if either argument is not a number,
-//      or if the second argument is a zero
-Value *primitiveDivide(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(29);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(29);
-
-    Value *n1 = car(args);
-    Value *n2 = car(cdr(args));
-    if((n1->type != DOUBLE_TYPE && n1->type != INT_TYPE) ||
-       (n2->type != DOUBLE_TYPE && n2->type != INT_TYPE)) evalError(29);
-    double val1;
-    double val2;
-    if(n1->type == DOUBLE_TYPE) val1 = n1->d;
-    else val1 = n1->i;
-    if(n2->type == DOUBLE_TYPE) val2 = n2->d;
-    else val2 = n2->i;
-    if(val2 == 0) evalError(30);
-    Value *res = (Value *)talloc(sizeof(Value));
-    res->type = DOUBLE_TYPE;
-    res->d = val1 / val2;
-    return res;
-}
-
-// Evaluates a modulo expression
-// Causes an evaluation error if there aren't two arguments,
-//      if either argument is not a number
-Value *primitiveModulo(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(32);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(32);
-
-    Value *n1 = car(args);
-    Value *n2 = car(cdr(args));
-    if(n1->type != INT_TYPE || n2->type != INT_TYPE) evalError(32);
-    Value *res = (Value *)talloc(sizeof(Value));
-    res->type = INT_TYPE;
-    res->i = n1->i % n2->i;
-    return res;
-}
-
-// Evaluates a - expression
-// Causes an evaluation error if any of the arguments are not numbers
-Value *primitiveSubtract(Value *args) {
-    // error checking
-    assert(args);
-    assert(args->type == CONS_TYPE || isNull(args));
-
-    Value *result = (Value *)talloc(sizeof(Value));
-    result->type = DOUBLE_TYPE;
-    result->d = 0;
-    if(length(args) == 0) return result;
-    if(car(args)->type == INT_TYPE) result->d = car(args)->i;
-    else if(car(args)->type == DOUBLE_TYPE) result->d = car(args)->d;
-    else evalError(13);
-    Value *cur = cdr(args);
-    while(!isNull(cur)) {
-        if(car(cur)->type == INT_TYPE) result->d -= (car(cur))->i;
-        else if(car(cur)->type == DOUBLE_TYPE) result->d -= (car(cur))->d;
-        else evalError(13);
-        cur = cdr(cur);
-    }
-    return result;
-}
-
-// Evaluates a < expression
-// Causes an evaluation error if there aren't two numerical arguments
-Value *primitiveLessThan(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(33);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(33);
-
-    Value *n1 = car(args);
-    Value *n2 = car(cdr(args));
-    if((n1->type != DOUBLE_TYPE && n1->type != INT_TYPE) ||
-       (n2->type != DOUBLE_TYPE && n2->type != INT_TYPE)) evalError(33);
-    double val1;
-    double val2;
-    if(n1->type == DOUBLE_TYPE) val1 = n1->d;
-    else val1 = n1->i;
-    if(n2->type == DOUBLE_TYPE) val2 = n2->d;
-    else val2 = n2->i;
-    Value *res = (Value *)talloc(sizeof(Value));
-    res->type = BOOL_TYPE;
-    res->i = val1 < val2;
-    return res;
-}
-
-// Evaluates a > expression
-// Causes an evaluation error if there aren't two numerical arguments
-Value *primitiveGreaterThan(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(34);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(34);
-
-    Value *n1 = car(args);
-    Value *n2 = car(cdr(args));
-    if((n1->type != DOUBLE_TYPE && n1->type != INT_TYPE) ||
-       (n2->type != DOUBLE_TYPE && n2->type != INT_TYPE)) evalError(34);
-    double val1;
-    double val2;
-    if(n1->type == DOUBLE_TYPE) val1 = n1->d;
-    else val1 = n1->i;
-    if(n2->type == DOUBLE_TYPE) val2 = n2->d;
-    else val2 = n2->i;
-    Value *res = (Value *)talloc(sizeof(Value));
-    res->type = BOOL_TYPE;
-    res->i = val1 > val2;
-    return res;
-}
-
-// Evaluates a = expression
-// Causes an evaluation error if there aren't two numerical arguments
-Value *primitiveEqualTo(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(35);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(35);
-
-    Value *n1 = car(args);
-    Value *n2 = car(cdr(args));
-    if((n1->type != DOUBLE_TYPE && n1->type != INT_TYPE) ||
-       (n2->type != DOUBLE_TYPE && n2->type != INT_TYPE)) evalError(35);
-    double val1;
-    double val2;
-    if(n1->type == DOUBLE_TYPE) val1 = n1->d;
-    else val1 = n1->i;
-    if(n2->type == DOUBLE_TYPE) val2 = n2->d;
-    else val2 = n2->i;
-    Value *res = (Value *)talloc(sizeof(Value));
-    res->type = BOOL_TYPE;
-    res->i = val1 == val2;
-    return res;
-}
-
-// Evaluates a <= expression
-// Causes an evaluation error if there aren't two numerical arguments
-Value *primitiveLessThanOrEqualTo(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(36);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(36);
-
-    Value *n1 = car(args);
-    Value *n2 = car(cdr(args));
-    if((n1->type != DOUBLE_TYPE && n1->type != INT_TYPE) ||
-       (n2->type != DOUBLE_TYPE && n2->type != INT_TYPE)) evalError(36);
-    double val1;
-    double val2;
-    if(n1->type == DOUBLE_TYPE) val1 = n1->d;
-    else val1 = n1->i;
-    if(n2->type == DOUBLE_TYPE) val2 = n2->d;
-    else val2 = n2->i;
-    Value *res = (Value *)talloc(sizeof(Value));
-    res->type = BOOL_TYPE;
-    res->i = val1 <= val2;
-    return res;
-}
-
-// Evaluates a >= expression
-// Causes an evaluation error if there aren't two numerical arguments
-Value *primitiveGreaterThanOrEqualTo(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(37);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(37);
-
-    Value *n1 = car(args);
-    Value *n2 = car(cdr(args));
-    if((n1->type != DOUBLE_TYPE && n1->type != INT_TYPE) ||
-       (n2->type != DOUBLE_TYPE && n2->type != INT_TYPE)) evalError(37);
-    double val1;
-    double val2;
-    if(n1->type == DOUBLE_TYPE) val1 = n1->d;
-    else val1 = n1->i;
-    if(n2->type == DOUBLE_TYPE) val2 = n2->d;
-    else val2 = n2->i;
-    Value *res = (Value *)talloc(sizeof(Value));
-    res->type = BOOL_TYPE;
-    res->i = val1 >= val2;
-    return res;
-}
-
-// Evaluates a null? expression
-// Causes an evaluation error if there's not one argument
-Value *primitiveIsNull(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(16);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 1) evalError(16);
-
-    Value *boolVal = (Value *)talloc(sizeof(Value));
-    boolVal->type = BOOL_TYPE;
-    boolVal->i = isNull(car(args));
-    return boolVal;
-}
-
-// Evaluates a zero? expression
-// Causes an evaluation error if there's not one argument or if the argument
-//      isn't a number
-Value *primitiveIsZero(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(22);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 1) evalError(22);
-
-    Value *boolVal = (Value *)talloc(sizeof(Value));
-    boolVal->type = BOOL_TYPE;
-    if(car(args)->type == INT_TYPE) boolVal->i = car(args)->i == 0;
-    else if(car(args)->type == DOUBLE_TYPE) boolVal->i = car(args)->d == 0;
-    else evalError(23);
-    return boolVal;
-}
-
-// Evaluates a car expression
-// Causes an evaluation error if there's not one argument,
-//      or if the argument is not a list
-Value *primitiveCar(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(17);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 1) evalError(17);
-    if(car(args)->type != CONS_TYPE) evalError(20);
-
-    return car(car(args));
-}
-
-// Evaluates a cdr expression
-// Causes an evaluation error if there's not one argument,
-//      or if the argument is not a list
-Value *primitiveCdr(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(18);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 1) evalError(18);
-    if(car(args)->type != CONS_TYPE) evalError(21);
-
-    return cdr(car(args));
-}
-
-// Evaluates a cons expression
-// Causes an evaluation error if there's not two arguments
-Value *primitiveCons(Value *args) {
-    // error checking
-    assert(args);
-    if(isNull(args)) evalError(19);
-    assert(args->type == CONS_TYPE);
-    if(length(args) != 2) evalError(19);
-
-    return cons(car(args), car(cdr(args)));
-}
-
-// Binds the given function to the given name in the given frame
-void bind(char *name, Value *(*function)(struct Value *), Frame *frame) {
-    // error checking
-    assert(name);
-    assert(function);
-    assert(frame);
-
-    Value *value = (Value *)talloc(sizeof(Value));
-    value->type = PRIMITIVE_TYPE;
-    value->pf = function;
-    Value *symbol = (Value *)talloc(sizeof(Value));
-    symbol->type = SYMBOL_TYPE;
-    symbol->s = name;
-    Value *binding = makeBinding(symbol, value);
-    frame->bindings = cons(binding, frame->bindings);
-}
-
-// Looks up the given symbol in the given frame and its parents
-// Throws an evaluation if the symbol doesn't exist
-Value *lookupSymbol(Value *symbol, Frame *frame) {
-    // error checking
-    assert(symbol);
-    assert(frame);
-    assert(symbol->type == SYMBOL_TYPE);
-
-    Frame *curFrame = frame;
-    while(curFrame != NULL) {
-        Value *curBinding = curFrame->bindings;
-        while(!isNull(curBinding)) {
-            if(!strcmp(symbol->s, var(car(curBinding))->s)) return val(car(curBinding));
-            curBinding = cdr(curBinding);
-        }
-        curFrame = curFrame->parent;
-    }
-    evalError(4);
-    return makeNull();
-}
-
-// Helper function to copy a frame completely (deep clone)
-Frame *copyFrame(Frame *frame) {
-    // error checking
-    assert(frame);
-
-    Frame *newFrame = (Frame *)talloc(sizeof(Frame));
-    newFrame->parent = frame->parent;
-    newFrame->bindings = frame->bindings;
-    return newFrame;
-}
-
-// Helper function that applies a closure to the given arguments
-// Causes an evaluation error if there are not enough or too many
-//      arguments for the given function
-Value *applyClosure(Value *function, Value *args) {
-    // error checking
-    assert(function);
-    assert(args);
-    assert(function->type == CLOSURE_TYPE);
-    assert(args->type == CONS_TYPE || isNull(args));
-
-    Frame *frame = copyFrame(function->cl.frame);
-    Value *values = args;
-    Value *bindings = makeNull();
-    Value *variables = function->cl.paramNames;
-    while(!isNull(variables)) {
-        if(isNull(values)) evalError(14);
-        Value *var = car(variables);
-        Value *val = car(values);
-        Value *b = makeBinding(var, val);
-        bindings = cons(b, bindings);
-        values = cdr(values);
-        variables = cdr(variables);
-    }
-    frame->bindings = bindings;
-    if(!isNull(values)) evalError(15);
-    return eval(function->cl.functionCode, frame);
-}
-
-// Applys a function that is a primitve function to the given arguments
-Value *applyPrimitive(Value *function, Value *args) {
-    // error checking
-    assert(function);
-    assert(args);
-    assert(function->type == PRIMITIVE_TYPE);
-    assert(args->type == CONS_TYPE || isNull(args));
-
-    return (function->pf)(args);
-}
-
-// Executes the given function using the given arguments
-Value *apply(Value *function, Value *args) {
-    // error checking
-    assert(function);
-    assert(args);
-    assert(args->type == CONS_TYPE || isNull(args));
-    assert(function->type == CLOSURE_TYPE || function->type == PRIMITIVE_TYPE);
-
-    if(function->type == CLOSURE_TYPE) return applyClosure(function, args);
-    else return applyPrimitive(function, args);
-}
-
-// Returns a list of each argument evaluated
-Value *evalEach(Value *args, Frame *frame) {
-    // error checking
-    assert(args);
-    assert(frame);
-    assert(args->type == CONS_TYPE || isNull(args));
-
-    Value *evaledArgs = makeNull();
-    Value *cur = args;
-    Value *evaled;
-    while(!isNull(cur)) {
-        evaled = eval(car(cur), frame);
-        evaledArgs = cons(evaled, evaledArgs);
-        cur = cdr(cur);
-    }
-    return reverse(evaledArgs);
-}
-
-// Evaluates the given scheme expression
-// Throws an evaluation error if an invalid function is called,
-//      or if an unexpected error occurs
-Value *eval(Value *expr, Frame *frame) {
-    // error checking
-    assert(expr);
-    assert(frame);
-
-    if(expr->type == INT_TYPE || expr->type == DOUBLE_TYPE ||
-        expr->type == BOOL_TYPE || expr->type == STR_TYPE ||
-        expr->type == NULL_TYPE) {
-        return expr;
-    } else if(expr->type == SYMBOL_TYPE) {
-        return lookupSymbol(expr, frame);
-    } else if(expr->type == CONS_TYPE) {
-        Value *first = car(expr);
-        if(first->type != SYMBOL_TYPE && first->type != CONS_TYPE) evalError(3);
-        Value *args = cdr(expr);
-
-        // special forms
-        if(!strcmp(first->s, "if")) return evalIf(args, frame);
-        if(!strcmp(first->s, "cond")) return evalCond(args, frame);
-        if(!strcmp(first->s, "and")) return evalAnd(args, frame);
-        if(!strcmp(first->s, "or")) return evalOr(args, frame);
-        if(!strcmp(first->s, "let")) return evalLet(args, frame);
-        if(!strcmp(first->s, "let*")) return evalLetStar(args, frame);
-        if(!strcmp(first->s, "letrec")) return evalLetRec(args, frame);
-        if(!strcmp(first->s, "quote")) return evalQuote(args);
-        if(!strcmp(first->s, "define")) return evalDefine(args, frame);
-        if(!strcmp(first->s, "set!")) return evalSet(args, frame);
-        if(!strcmp(first->s, "lambda")) return evalLambda(args, frame);
-        if(!strcmp(first->s, "begin")) return evalBegin(args, frame);
-
-        else {
-            Value *evaledOperator = eval(first, frame);
-            Value *evaledArgs = evalEach(args, frame);
-            return apply(evaledOperator, evaledArgs);
-        }
-    } else {
-        evalError(7);
-    }
-    return makeNull();
-}
-
-// Interprets the given parsed scheme program
-void interpret(Value *tree) {
-    // error checking
-    assert(tree);
-    assert(tree->type == CONS_TYPE);
-
-    // binds primitive functions to the top level frame
-    Frame *frame = (Frame *)talloc(sizeof(Frame));
-    frame->parent = NULL;
-    frame->bindings = makeNull();
-    bind("+", primitiveAdd, frame);
-    bind("-", primitiveSubtract, frame);
-    bind("null?", primitiveIsNull, frame);
-    bind("zero?", primitiveIsZero, frame);
-    bind("car", primitiveCar, frame);
-    bind("cdr", primitiveCdr, frame);
-    bind("cons", primitiveCons, frame);
-    bind("*", primitiveMultiply, frame);
-    bind("/", primitiveDivide, frame);
-    bind("modulo", primitiveModulo, frame);
-    bind("<", primitiveLessThan, frame);
-    bind(">", primitiveGreaterThan, frame);
-    bind("=", primitiveEqualTo, frame);
-    bind("<=", primitiveLessThanOrEqualTo, frame);
-    bind(">=", primitiveGreaterThanOrEqualTo, frame);
-
-    Value *cur = tree;
-    Value *evaled;
-    while(!isNull(cur)) {
-        evaled = eval(car(cur), frame);
-        display(evaled);
-        if(evaled->type != VOID_TYPE) printf("\n");
-        cur = cdr(cur);
-    }
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "gc.h"
+#include "symbol.h"
+#include "number.h"
+#include "hashtable.h"
+#include "text.h"
+#include "output.h"
+#include "resolver.h"
+#include "compiler.h"
+#include "vm.h"
+#include "source.h"
+#include "parser.h"
+#include "optimizer.h"
+#include "interpreter.h"
+
+// The empty frame that top level expressions run in
+Frame *topFrame = NULL;
+
+// Helper function to print error codes and exit the program
+void evalError(int errorCode) {
+    if(errorCode == 1) printf("\'if\' requires 3 arguments");
+    else if(errorCode == 2) printf("\'let\' can only assign expressions to symbols");
+    else if(errorCode == 3) printf("Function name must be a symbol");
+    else if(errorCode == 4) printf("Symbol undefined");
+    else if(errorCode == 5) printf("\'let\' requires a list of tuples as the first argument");
+    else if(errorCode == 6) printf("\'let\' requires 2 arguments");
+    else if(errorCode == 7) printf("Evaluation error");
+    else if(errorCode == 8) printf("\'quote\' requires one argument");
+    else if(errorCode == 9) printf("\'define\' requires two arguments");
+    else if(errorCode == 10) printf("\'define\' can only assign expressions to symbols");
+    else if(errorCode == 11) printf("\'lambda\' requires two arguments");
+    else if(errorCode == 12) printf("The first argument of \'lambda\' must be a list of arguments");
+    else if(errorCode == 13) printf("All arguments to \'+\' must evaluate to numbers");
+    else if(errorCode == 14) printf("Not enough arguments provided");
+    else if(errorCode == 15) printf("Too many arguments provided");
+    else if(errorCode == 16) printf("\'null?\' requires one argument");
+    else if(errorCode == 17) printf("\'car\' requires one argument");
+    else if(errorCode == 18) printf("\'cdr\' requires one argument");
+    else if(errorCode == 19) printf("\'cons\' requires two arguments");
+    else if(errorCode == 20) printf("\'car\' requires a list as an argument");
+    else if(errorCode == 21) printf("\'cdr\' requires a list as an argument");
+    else if(errorCode == 22) printf("\'zero?\' requires one argument");
+    else if(errorCode == 23) printf("\'zero?\' requires a number as an argument");
+    else if(errorCode == 24) printf("\'and\' requires 2 arguments");
+    else if(errorCode == 25) printf("\'and\' requires booleans as arguments");
+    else if(errorCode == 26) printf("\'or\' requires 2 arguments");
+    else if(errorCode == 27) printf("\'or\' requires booleans as arguments");
+    else if(errorCode == 28) printf("\'cond\' requires tuples where the first item evaluates to a boolean as arguments");
+    else if(errorCode == 29) printf("\'/\' requires two numbers as arguments");
+    else if(errorCode == 30) printf("Division by zero");
+    else if(errorCode == 31) printf("All arguments to \'*\' must evaluate to numbers");
+    else if(errorCode == 32) printf("\'modulo\' requires two integer arguments");
+    else if(errorCode == 33) printf("\'<\' requires two numerical arguments");
+    else if(errorCode == 34) printf("\'>\' requires two numerical arguments");
+    else if(errorCode == 35) printf("\'=\' requires two numerical arguments");
+    else if(errorCode == 36) printf("\'<=\' requires two numerical arguments");
+    else if(errorCode == 37) printf("\'>=\' requires two numerical arguments");
+    else if(errorCode == 38) printf("\'make-vector\' requires one or two arguments");
+    else if(errorCode == 39) printf("\'make-vector\' requires a nonnegative integer length");
+    else if(errorCode == 40) printf("\'vector-ref\' requires two arguments");
+    else if(errorCode == 41) printf("\'vector-set!\' requires three arguments");
+    else if(errorCode == 42) printf("\'vector-length\' requires one argument");
+    else if(errorCode == 43) printf("\'vector-fill!\' requires two arguments");
+    else if(errorCode == 44) printf("\'vector->list\' requires one argument");
+    else if(errorCode == 45) printf("\'list->vector\' requires one argument");
+    else if(errorCode == 46) printf("Vector procedures require a vector as the first argument");
+    else if(errorCode == 47) printf("Vector index out of range");
+    else if(errorCode == 48) printf("\'list->vector\' requires a list as an argument");
+    else if(errorCode == 49) printf("\'eq?\' requires two arguments");
+    else if(errorCode == 50) printf("\'eqv?\' requires two arguments");
+    else if(errorCode == 51) printf("\'equal?\' requires two arguments");
+    else if(errorCode == 52) printf("\'make-hash-table\' requires at most one argument");
+    else if(errorCode == 53) printf("\'make-hash-table\' requires eq?, eqv? or equal? as its argument");
+    else if(errorCode == 54) printf("\'hash-table-ref\' requires two or three arguments");
+    else if(errorCode == 55) printf("\'hash-table-set!\' requires three arguments");
+    else if(errorCode == 56) printf("\'hash-table-delete!\' requires two arguments");
+    else if(errorCode == 57) printf("\'hash-table-count\' requires one argument");
+    else if(errorCode == 58) printf("\'hash-table-keys\' requires one argument");
+    else if(errorCode == 59) printf("\'hash-table-values\' requires one argument");
+    else if(errorCode == 60) printf("\'hash-table->alist\' requires one argument");
+    else if(errorCode == 61) printf("Hash table procedures require a hash table as the first argument");
+    else if(errorCode == 62) printf("Key not found in hash table");
+    else if(errorCode == 63) printf("\'string-length\' requires one argument");
+    else if(errorCode == 64) printf("\'string-ref\' requires two arguments");
+    else if(errorCode == 65) printf("\'substring\' requires three arguments");
+    else if(errorCode == 66) printf("\'string->symbol\' requires one argument");
+    else if(errorCode == 67) printf("\'symbol->string\' requires one argument");
+    else if(errorCode == 68) printf("\'open-output-string\' requires no arguments");
+    else if(errorCode == 69) printf("\'write-string\' requires two arguments");
+    else if(errorCode == 70) printf("\'get-output-string\' requires one argument");
+    else if(errorCode == 71) printf("String procedures require strings as arguments");
+    else if(errorCode == 72) printf("String index out of range");
+    else if(errorCode == 73) printf("\'symbol->string\' requires a symbol as an argument");
+    else if(errorCode == 74) printf("String port procedures require a string port");
+    else if(errorCode == 75) printf("String too long");
+    else printf("Evaluation error");
+    printf("\n");
+    texit(errorCode);
+}
+
+// Evaluates a + expression
+// Causes an evaluation error if any of the arguments are not numbers
+Value *primitiveAdd(int argc, Value **argv) {
+    Value *result = makeFixnum(0);
+    for(int i = 0; i < argc; i++) {
+        if(!isNumeric(argv[i])) evalError(13);
+        result = numberAdd(result, argv[i]);
+    }
+    return result;
+}
+
+// Evaluates a * expression
+// Causes an evaluation error if any of the arguments are not numbers
+Value *primitiveMultiply(int argc, Value **argv) {
+    if(argc == 0) return makeFixnum(0);
+    Value *result = makeFixnum(1);
+    for(int i = 0; i < argc; i++) {
+        if(!isNumeric(argv[i])) evalError(31);
+        result = numberMultiply(result, argv[i]);
+    }
+    return result;
+}
+
+// Evaluates a / expression, which takes two arguments
+// Causes an evaluation error if either argument is not a number,
+//      or if the second argument is a zero
+Value *primitiveDivide(int argc, Value **argv) {
+    assert(argc == 2);
+    if(!isNumeric(argv[0]) || !isNumeric(argv[1])) evalError(29);
+    if(numberIsZero(argv[1])) evalError(30);
+    return numberDivide(argv[0], argv[1]);
+}
+
+// Evaluates a modulo expression, which takes two arguments
+// Causes an evaluation error if either argument is not an integer,
+//      or if the second argument is a zero
+Value *primitiveModulo(int argc, Value **argv) {
+    assert(argc == 2);
+    if(!isExact(argv[0]) || !isExact(argv[1])) evalError(32);
+    if(numberIsZero(argv[1])) evalError(30);
+    return numberRemainder(argv[0], argv[1]);
+}
+
+// Evaluates a - expression
+// Causes an evaluation error if any of the arguments are not numbers
+Value *primitiveSubtract(int argc, Value **argv) {
+    if(argc == 0) return makeFixnum(0);
+    if(!isNumeric(argv[0])) evalError(13);
+    Value *result = argv[0];
+    for(int i = 1; i < argc; i++) {
+        if(!isNumeric(argv[i])) evalError(13);
+        result = numberSubtract(result, argv[i]);
+    }
+    return result;
+}
+
+// Compares the two arguments of a numerical comparison, which takes two
+// arguments, and returns a negative number, zero or a positive number as the
+// first is less than, equal to or greater than the second
+// Causes the given evaluation error if either argument is not a number
+int compareArguments(int argc, Value **argv, int errorCode) {
+    assert(argc == 2);
+    if(!isNumeric(argv[0]) || !isNumeric(argv[1])) evalError(errorCode);
+    return numberCompare(argv[0], argv[1]);
+}
+
+// Evaluates a < expression
+// Causes an evaluation error if the arguments aren't numbers
+Value *primitiveLessThan(int argc, Value **argv) {
+    return makeBool(compareArguments(argc, argv, 33) < 0);
+}
+
+// Evaluates a > expression
+// Causes an evaluation error if the arguments aren't numbers
+Value *primitiveGreaterThan(int argc, Value **argv) {
+    return makeBool(compareArguments(argc, argv, 34) > 0);
+}
+
+// Evaluates a = expression
+// Causes an evaluation error if the arguments aren't numbers
+Value *primitiveEqualTo(int argc, Value **argv) {
+    return makeBool(compareArguments(argc, argv, 35) == 0);
+}
+
+// Evaluates a <= expression
+// Causes an evaluation error if the arguments aren't numbers
+Value *primitiveLessThanOrEqualTo(int argc, Value **argv) {
+    return makeBool(compareArguments(argc, argv, 36) <= 0);
+}
+
+// Evaluates a >= expression
+// Causes an evaluation error if the arguments aren't numbers
+Value *primitiveGreaterThanOrEqualTo(int argc, Value **argv) {
+    return makeBool(compareArguments(argc, argv, 37) >= 0);
+}
+
+// Evaluates a null? expression, which takes one argument
+Value *primitiveIsNull(int argc, Value **argv) {
+    assert(argc == 1);
+    return makeBool(isNull(argv[0]));
+}
+
+// Evaluates a zero? expression, which takes one argument
+// Causes an evaluation error if the argument isn't a number
+Value *primitiveIsZero(int argc, Value **argv) {
+    assert(argc == 1);
+    if(!isNumeric(argv[0])) evalError(23);
+    return makeBool(numberIsZero(argv[0]));
+}
+
+// Evaluates a car expression, which takes one argument
+// Causes an evaluation error if the argument is not a list
+Value *primitiveCar(int argc, Value **argv) {
+    assert(argc == 1);
+    if(typeOf(argv[0]) != CONS_TYPE) evalError(20);
+    return car(argv[0]);
+}
+
+// Evaluates a cdr expression, which takes one argument
+// Causes an evaluation error if the argument is not a list
+Value *primitiveCdr(int argc, Value **argv) {
+    assert(argc == 1);
+    if(typeOf(argv[0]) != CONS_TYPE) evalError(21);
+    return cdr(argv[0]);
+}
+
+// Evaluates a cons expression, which takes two arguments
+Value *primitiveCons(int argc, Value **argv) {
+    assert(argc == 2);
+    return cons(argv[0], argv[1]);
+}
+
+// Evaluates a make-vector expression, which takes a length and optionally
+// the value to fill the vector with, 0 by default
+// Causes an evaluation error if the length is not a nonnegative fixnum
+Value *primitiveMakeVector(int argc, Value **argv) {
+    assert(argc == 1 || argc == 2);
+    if(!isFixnum(argv[0]) || fixnumValue(argv[0]) < 0 ||
+        (size_t)fixnumValue(argv[0]) > GC_MAX_SIZE / sizeof(Value *)) evalError(39);
+    return makeVector(fixnumValue(argv[0]), argc == 2 ? argv[1] : makeFixnum(0));
+}
+
+// Evaluates a vector expression, which makes a vector of its arguments
+Value *primitiveVector(int argc, Value **argv) {
+    Value *vector = makeVector(argc, makeNull());
+    memcpy(vector->vec.items, argv, argc * sizeof(Value *));
+    return vector;
+}
+
+// Returns the element of the vector that the given index refers to
+// Causes an evaluation error if the first value is not a vector,
+//      or if the index is not an integer within its length
+Value **vectorElement(Value *vector, Value *index) {
+    if(typeOf(vector) != VECTOR_TYPE) evalError(46);
+    if(!isFixnum(index) || fixnumValue(index) < 0 ||
+        fixnumValue(index) >= vector->vec.length) evalError(47);
+    return &vector->vec.items[fixnumValue(index)];
+}
+
+// Evaluates a vector-ref expression, which takes a vector and an index
+Value *primitiveVectorRef(int argc, Value **argv) {
+    assert(argc == 2);
+    return *vectorElement(argv[0], argv[1]);
+}
+
+// Evaluates a vector-set! expression, which takes a vector, an index and the
+// value to store there
+Value *primitiveVectorSet(int argc, Value **argv) {
+    assert(argc == 3);
+    *vectorElement(argv[0], argv[1]) = argv[2];
+    gcWriteBarrier(argv[0]->vec.items, argv[2]);
+    return makeVoid();
+}
+
+// Evaluates a vector-length expression, which takes one argument
+// Causes an evaluation error if the argument is not a vector
+Value *primitiveVectorLength(int argc, Value **argv) {
+    assert(argc == 1);
+    if(typeOf(argv[0]) != VECTOR_TYPE) evalError(46);
+    return makeFixnum(argv[0]->vec.length);
+}
+
+// Evaluates a vector-fill! expression, which stores its second argument into
+// every element of its first
+// Causes an evaluation error if the first argument is not a vector
+Value *primitiveVectorFill(int argc, Value **argv) {
+    assert(argc == 2);
+    if(typeOf(argv[0]) != VECTOR_TYPE) evalError(46);
+    for(int i = 0; i < argv[0]->vec.length; i++) argv[0]->vec.items[i] = argv[1];
+    gcWriteBarrier(argv[0]->vec.items, argv[1]);
+    return makeVoid();
+}
+
+// Evaluates a vector->list expression, which takes one argument
+// Causes an evaluation error if the argument is not a vector
+Value *primitiveVectorToList(int argc, Value **argv) {
+    assert(argc == 1);
+    if(typeOf(argv[0]) != VECTOR_TYPE) evalError(46);
+    return vectorToList(argv[0]);
+}
+
+// Evaluates a list->vector expression, which takes one argument
+// Causes an evaluation error if the argument is not a proper list
+Value *primitiveListToVector(int argc, Value **argv) {
+    assert(argc == 1);
+    Value *cur = argv[0];
+    while(typeOf(cur) == CONS_TYPE) cur = cdr(cur);
+    if(!isNull(cur)) evalError(48);
+    return listToVector(argv[0]);
+}
+
+// Evaluates an eq? expression, which takes two arguments
+Value *primitiveEq(int argc, Value **argv) {
+    assert(argc == 2);
+    return makeBool(isEq(argv[0], argv[1]));
+}
+
+// Evaluates an eqv? expression, which takes two arguments
+Value *primitiveEqv(int argc, Value **argv) {
+    assert(argc == 2);
+    return makeBool(isEqv(argv[0], argv[1]));
+}
+
+// Evaluates an equal? expression, which takes two arguments
+Value *primitiveEqual(int argc, Value **argv) {
+    assert(argc == 2);
+    return makeBool(isEqual(argv[0], argv[1]));
+}
+
+// Evaluates a make-hash-table expression, which takes the eq?, eqv? or
+// equal? primitive that compares its keys, equal? by default
+// Causes an evaluation error if the argument is anything else
+Value *primitiveMakeHashTable(int argc, Value **argv) {
+    assert(argc <= 1);
+    if(argc == 0) return makeHashTable(EQUAL_TEST);
+    if(typeOf(argv[0]) != PRIMITIVE_TYPE) evalError(53);
+    if(argv[0]->prim.function == primitiveEq) return makeHashTable(EQ_TEST);
+    if(argv[0]->prim.function == primitiveEqv) return makeHashTable(EQV_TEST);
+    if(argv[0]->prim.function == primitiveEqual) return makeHashTable(EQUAL_TEST);
+    evalError(53);
+    return NULL;
+}
+
+// Causes an evaluation error if the given value is not a hash table
+void checkHashTable(Value *table) {
+    if(typeOf(table) != HASH_TABLE_TYPE) evalError(61);
+}
+
+// Evaluates a hash-table-ref expression, which takes a table, a key and
+// optionally what to return if the key isn't in the table
+// Causes an evaluation error if it isn't and there's nothing to return
+Value *primitiveHashTableRef(int argc, Value **argv) {
+    assert(argc == 2 || argc == 3);
+    checkHashTable(argv[0]);
+    Value *value = hashTableRef(argv[0], argv[1]);
+    if(value != NULL) return value;
+    if(argc == 2) evalError(62);
+    return argv[2];
+}
+
+// Evaluates a hash-table-set! expression, which takes a table, a key and the
+// value to store under it
+Value *primitiveHashTableSet(int argc, Value **argv) {
+    assert(argc == 3);
+    checkHashTable(argv[0]);
+    hashTableSet(argv[0], argv[1], argv[2]);
+    return makeVoid();
+}
+
+// Evaluates a hash-table-delete! expression, which takes a table and a key
+Value *primitiveHashTableDelete(int argc, Value **argv) {
+    assert(argc == 2);
+    checkHashTable(argv[0]);
+    hashTableDelete(argv[0], argv[1]);
+    return makeVoid();
+}
+
+// Evaluates a hash-table-count expression, which takes a table
+Value *primitiveHashTableCount(int argc, Value **argv) {
+    assert(argc == 1);
+    checkHashTable(argv[0]);
+    return makeFixnum(argv[0]->ht.count);
+}
+
+// Returns a list with an element for each entry of the given table: its key,
+// its value, or a pair of both
+Value *hashTableEntries(Value *table, bool keys, bool values) {
+    checkHashTable(table);
+    Value *list = makeNull();
+    for(int slot = hashTableNext(table, 0); slot >= 0; slot = hashTableNext(table, slot + 1)) {
+        Value *entry;
+        if(!values) entry = hashTableKey(table, slot);
+        else if(!keys) entry = hashTableValue(table, slot);
+        else entry = cons(hashTableKey(table, slot), hashTableValue(table, slot));
+        list = cons(entry, list);
+    }
+    return list;
+}
+
+// Evaluates a hash-table-keys expression, which takes a table
+Value *primitiveHashTableKeys(int argc, Value **argv) {
+    assert(argc == 1);
+    return hashTableEntries(argv[0], true, false);
+}
+
+// Evaluates a hash-table-values expression, which takes a table
+Value *primitiveHashTableValues(int argc, Value **argv) {
+    assert(argc == 1);
+    return hashTableEntries(argv[0], false, true);
+}
+
+// Evaluates a hash-table->alist expression, which takes a table
+Value *primitiveHashTableToAlist(int argc, Value **argv) {
+    assert(argc == 1);
+    return hashTableEntries(argv[0], true, true);
+}
+
+// Causes an evaluation error if the given value is not a string
+void checkString(Value *string) {
+    if(typeOf(string) != STR_TYPE) evalError(71);
+}
+
+// Returns the number that the given index of the string refers to
+// Causes an evaluation error if the index is not an integer from 0 to limit
+size_t stringIndex(Value *index, size_t limit) {
+    if(!isFixnum(index) || fixnumValue(index) < 0 ||
+        (size_t)fixnumValue(index) > limit) evalError(72);
+    return fixnumValue(index);
+}
+
+// Evaluates a string-length expression, which takes one argument
+// Causes an evaluation error if the argument is not a string
+Value *primitiveStringLength(int argc, Value **argv) {
+    assert(argc == 1);
+    checkString(argv[0]);
+    return makeFixnum(argv[0]->str.length);
+}
+
+// Evaluates a string-ref expression, which takes a string and an index.
+// There's no character type, so the character comes back as a string of
+// length one, which shares the characters of the string.
+Value *primitiveStringRef(int argc, Value **argv) {
+    assert(argc == 2);
+    checkString(argv[0]);
+    if(argv[0]->str.length == 0) evalError(72);
+    size_t index = stringIndex(argv[1], argv[0]->str.length - 1);
+    return substring(argv[0], index, index + 1);
+}
+
+// Evaluates a substring expression, which takes a string, a start index and
+// an end index. The result shares the characters of the string.
+// Causes an evaluation error if the indices don't lie in order in the string
+Value *primitiveSubstring(int argc, Value **argv) {
+    assert(argc == 3);
+    checkString(argv[0]);
+    size_t end = stringIndex(argv[2], argv[0]->str.length);
+    size_t start = stringIndex(argv[1], end);
+    return substring(argv[0], start, end);
+}
+
+// Evaluates a string-append expression, which takes any number of strings
+// Causes an evaluation error if the result would be too long
+Value *primitiveStringAppend(int argc, Value **argv) {
+    size_t length = 0;
+    for(int i = 0; i < argc; i++) {
+        checkString(argv[i]);
+        length += argv[i]->str.length;
+    }
+    if(length > STRING_MAX) evalError(75);
+    return stringAppend(argc, argv);
+}
+
+// Evaluates a string->symbol expression, which takes one argument
+Value *primitiveStringToSymbol(int argc, Value **argv) {
+    assert(argc == 1);
+    checkString(argv[0]);
+    return internLength(stringChars(argv[0]), argv[0]->str.length);
+}
+
+// Evaluates a symbol->string expression, which takes one argument. Symbol
+// names are never freed, so the string shares the name.
+Value *primitiveSymbolToString(int argc, Value **argv) {
+    assert(argc == 1);
+    if(typeOf(argv[0]) != SYMBOL_TYPE) evalError(73);
+    return shareString(argv[0]->s, strlen(argv[0]->s));
+}
+
+// Evaluates an open-output-string expression, which takes no arguments
+Value *primitiveOpenOutputString(int argc, Value **argv) {
+    assert(argc == 0);
+    (void)argv;
+    return makeStringPort();
+}
+
+// Causes an evaluation error if the given value is not a string port
+void checkStringPort(Value *port) {
+    if(typeOf(port) != STRING_PORT_TYPE) evalError(74);
+}
+
+// Evaluates a write-string expression, which takes a string and the string
+// port to add it to
+Value *primitiveWriteString(int argc, Value **argv) {
+    assert(argc == 2);
+    checkString(argv[0]);
+    checkStringPort(argv[1]);
+    if((size_t)argv[1]->port.length + argv[0]->str.length > STRING_MAX) evalError(75);
+    portWrite(argv[1], stringChars(argv[0]), argv[0]->str.length);
+    return makeVoid();
+}
+
+// Evaluates a get-output-string expression, which takes a string port
+Value *primitiveGetOutputString(int argc, Value **argv) {
+    assert(argc == 1);
+    checkStringPort(argv[0]);
+    return portString(argv[0]);
+}
+
+// Binds the given function to the given name in the global table. It takes
+// from minArgs to maxArgs arguments, or any number from minArgs if maxArgs
+// is -1; calling it with any other number causes arityError. fixnumOp is the
+// instruction that does what the function does to two fixnums, which call
+// sites that only see fixnums turn into, or 0 if there isn't one.
+void bind(char *name, Value *(*function)(int, Value **), int minArgs, int maxArgs,
+          int arityError, opcode fixnumOp) {
+    // error checking
+    assert(name);
+    assert(function);
+    assert(maxArgs < 0 || maxArgs >= minArgs);
+
+    Value *value = gcAllocValue();
+    value->type = PRIMITIVE_TYPE;
+    value->prim.function = function;
+    value->prim.minArgs = minArgs;
+    value->prim.maxArgs = maxArgs;
+    value->prim.arityError = arityError;
+    value->prim.fixnumOp = fixnumOp;
+    Value *cell = globalCell(intern(name));
+    cell->b.val = value;
+    gcWriteBarrier(cell, value);
+}
+
+// Evaluates the given scheme expression in the given frame by compiling it
+//      and running it on the virtual machine
+Value *eval(Value *expr, Frame *frame) {
+    // error checking
+    assert(expr);
+    assert(frame);
+
+    return vmRun(compile(resolve(expr)), frame);
+}
+
+// Visits the top level frame for the garbage collector
+void visitTopFrame() {
+    gcVisit((void **)&topFrame);
+}
+
+// Binds the primitive functions and makes the top level frame
+void initInterpreter() {
+    // binds primitive functions to global variables
+    initResolver();
+    bind("+", primitiveAdd, 0, -1, 0, OP_ADD_FIXNUMS);
+    bind("-", primitiveSubtract, 0, -1, 0, OP_SUBTRACT_FIXNUMS);
+    bind("null?", primitiveIsNull, 1, 1, 16, 0);
+    bind("zero?", primitiveIsZero, 1, 1, 22, 0);
+    bind("car", primitiveCar, 1, 1, 17, 0);
+    bind("cdr", primitiveCdr, 1, 1, 18, 0);
+    bind("cons", primitiveCons, 2, 2, 19, 0);
+    bind("*", primitiveMultiply, 0, -1, 0, OP_MULTIPLY_FIXNUMS);
+    bind("/", primitiveDivide, 2, 2, 29, 0);
+    bind("modulo", primitiveModulo, 2, 2, 32, 0);
+    bind("<", primitiveLessThan, 2, 2, 33, OP_LESS_FIXNUMS);
+    bind(">", primitiveGreaterThan, 2, 2, 34, OP_GREATER_FIXNUMS);
+    bind("=", primitiveEqualTo, 2, 2, 35, OP_EQUAL_FIXNUMS);
+    bind("<=", primitiveLessThanOrEqualTo, 2, 2, 36, OP_LESS_EQUAL_FIXNUMS);
+    bind(">=", primitiveGreaterThanOrEqualTo, 2, 2, 37, OP_GREATER_EQUAL_FIXNUMS);
+    bind("make-vector", primitiveMakeVector, 1, 2, 38, 0);
+    bind("vector", primitiveVector, 0, -1, 0, 0);
+    bind("vector-ref", primitiveVectorRef, 2, 2, 40, 0);
+    bind("vector-set!", primitiveVectorSet, 3, 3, 41, 0);
+    bind("vector-length", primitiveVectorLength, 1, 1, 42, 0);
+    bind("vector-fill!", primitiveVectorFill, 2, 2, 43, 0);
+    bind("vector->list", primitiveVectorToList, 1, 1, 44, 0);
+    bind("list->vector", primitiveListToVector, 1, 1, 45, 0);
+    bind("eq?", primitiveEq, 2, 2, 49, 0);
+    bind("eqv?", primitiveEqv, 2, 2, 50, 0);
+    bind("equal?", primitiveEqual, 2, 2, 51, 0);
+    bind("make-hash-table", primitiveMakeHashTable, 0, 1, 52, 0);
+    bind("hash-table-ref", primitiveHashTableRef, 2, 3, 54, 0);
+    bind("hash-table-set!", primitiveHashTableSet, 3, 3, 55, 0);
+    bind("hash-table-delete!", primitiveHashTableDelete, 2, 2, 56, 0);
+    bind("hash-table-count", primitiveHashTableCount, 1, 1, 57, 0);
+    bind("hash-table-keys", primitiveHashTableKeys, 1, 1, 58, 0);
+    bind("hash-table-values", primitiveHashTableValues, 1, 1, 59, 0);
+    bind("hash-table->alist", primitiveHashTableToAlist, 1, 1, 60, 0);
+    bind("string-length", primitiveStringLength, 1, 1, 63, 0);
+    bind("string-ref", primitiveStringRef, 2, 2, 64, 0);
+    bind("substring", primitiveSubstring, 3, 3, 65, 0);
+    bind("string-append", primitiveStringAppend, 0, -1, 0, 0);
+    bind("string->symbol", primitiveStringToSymbol, 1, 1, 66, 0);
+    bind("symbol->string", primitiveSymbolToString, 1, 1, 67, 0);
+    bind("open-output-string", primitiveOpenOutputString, 0, 0, 68, 0);
+    bind("write-string", primitiveWriteString, 2, 2, 69, 0);
+    bind("get-output-string", primitiveGetOutputString, 1, 1, 70, 0);
+
+    // every top level expression runs in an empty frame, since globals live
+    // in the resolver's table
+    Frame *frame = gcAllocFrame(0);
+    frame->parent = NULL;
+    topFrame = frame;
+    gcAddRoots(visitTopFrame);
+}
+
+// Optimizes and evaluates the given top level expression and prints its
+// result. The output is flushed before anything else can print, such as an
+// error or the next prompt.
+void evalAndDisplay(Value *expr) {
+    expr = optimize(expr);
+    if(dumpOptimized) {
+        display(expr);
+        outputChar('\n');
+        flushOutput();
+    }
+    Value *evaled = eval(expr, topFrame);
+    display(evaled);
+    if(typeOf(evaled) != VOID_TYPE) outputChar('\n');
+    flushOutput();
+}
+
+// Reads, evaluates and prints the top level expressions of the given source
+// one at a time, so each result is printed as soon as its expression has been
+// read. An interactive source prompts for each expression, and an error just
+// drops the rest of the line instead of ending the session.
+void interpretSource(Source *source) {
+    assert(source);
+    initInterpreter();
+    initOptimizer(source);
+    jmp_buf handler;
+    if(source->interactive) {
+        source->continuation = "  ";
+        if(setjmp(handler) != 0) {
+            vmReset();
+            discardSource(source);
+        }
+        setExitHandler(&handler);
+    }
+    Value *expr;
+    for(;;) {
+        source->prompt = "> ";
+        expr = readDatum(source);
+        if(expr == NULL) break;
+        evalAndDisplay(expr);
+    }
+    if(source->interactive) {
+        setExitHandler(NULL);
+        printf("\n");
+    }
+}
@@ -1,18 +1,34 @@
+#include "value.h"
+#include "source.h"
+
 #ifndef _INTERPRETER
 #define _INTERPRETER
 
-// A frame is a linked list of bindings, and a pointer to another frame.  A
-// binding is a variable name (represented as a string), and a pointer to the
-// Value it is bound to. Specifically how you implement the list of bindings is
-// up to you.
+// A frame is an array holding the values of the local variables of one scope,
+// and a pointer to the frame of the enclosing scope. The resolver decides
+// which slot each variable lives in; unassigned slots are NULL. Globals aren't
+// stored in frames, they live in cells in the resolver's global table.
 struct Frame {
-    Value *bindings;
     struct Frame *parent;
+    int size;
+    Value *slots[];
 };
 
 typedef struct Frame Frame;
 
-void interpret(Value *tree);
+// Reads, evaluates and prints the top level expressions of the given source
+// one at a time. On an interactive source this is a REPL that carries on
+// after errors.
+void interpretSource(Source *source);
+
 Value *eval(Value *expr, Frame *frame);
 
+// The primitives the JIT works out in place where it finds them called
+Value *primitiveIsZero(int argc, Value **argv);
+Value *primitiveCar(int argc, Value **argv);
+Value *primitiveCdr(int argc, Value **argv);
+
+// Prints the message for the given error code and exits the program with it
+void evalError(int errorCode);
+
 #endif
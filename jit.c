@@ -0,0 +1,784 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "gc.h"
+#include "interpreter.h"
+#include "vm.h"
+#include "jit.h"
+
+// A template JIT: each instruction of a hot function becomes a fixed run of
+// x86-64 instructions working on the same value stack, frames and
+// activations as the VM, so the two can hand a function back and forth at
+// any instruction. The machine code keeps the VM's stack pointer in rbx, the
+// frame in r12, the function's constants in r13 and the VMState in r14, all
+// of which C functions preserve. Calls and returns go through vmCall,
+// vmTailCall and vmReturn, which jump straight on to the callee's or the
+// caller's machine code when it has some. Anything the machine code can't do
+// quickly, such as a fixnum sum that overflows, leaves to the VM at that
+// instruction.
+
+bool jitEnabled = false;
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(NO_JIT)
+
+#include <sys/mman.h>
+
+// The registers, numbered as in their encodings
+enum {RAX,RCX,RDX,RBX,RSP,RBP,RSI,RDI,R8,R9,R10,R11,R12,R13,R14,R15};
+
+#define SP RBX
+#define FRAME R12
+#define CONSTANTS R13
+#define STATE R14
+
+// The condition codes of conditional jumps and moves
+enum {CC_O = 0x0,CC_NO = 0x1,CC_E = 0x4,CC_NE = 0x5,CC_L = 0xc,CC_GE = 0xd,
+    CC_LE = 0xe,CC_G = 0xf,CC_ALWAYS = -1};
+
+// The opcodes used, with the two byte ones starting with 0x0f
+#define MOV_STORE 0x89
+#define MOV_LOAD 0x8b
+#define LEA 0x8d
+#define ADD 0x01
+#define SUB 0x29
+#define AND 0x21
+#define CMP 0x39
+#define TEST 0x85
+#define IMUL 0x0faf
+#define CMOV(cc) (0x0f40 | (cc))
+#define ALU_IMM 0x81
+#define MOV_IMM32 0xc7
+
+// The extensions of ALU_IMM that pick the operation
+#define EXT_ADD 0
+#define EXT_OR 1
+#define EXT_SUB 5
+#define EXT_CMP 7
+
+// A jump to a label whose address may not be known yet
+typedef struct Patch Patch;
+struct Patch {
+    size_t at;
+    int label;
+};
+
+// A place the machine code leaves to the VM at an instruction, or causes an
+// evaluation error
+typedef struct Stub Stub;
+struct Stub {
+    int label;
+    uint32_t *ip;
+    int error;
+};
+
+// Machine code being assembled for one function. Labels are positions in the
+// code; the first ones are the function's instructions, in order, and any
+// made after them are local to an instruction.
+typedef struct Assembler Assembler;
+struct Assembler {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+    long *labels;
+    int labelCount;
+    int labelCapacity;
+    Patch *patches;
+    int patchCount;
+    int patchCapacity;
+    Stub *stubs;
+    int stubCount;
+    int stubCapacity;
+};
+
+// The shared code that enters compiled code from C and leaves it again
+void (*enterNative)(VMState *state, void *target) = NULL;
+void *exitNative = NULL;
+
+// The file perf reads the names of compiled functions from
+FILE *perfMap = NULL;
+
+// Every compiled function, which is kept alive for the rest of the run so its
+// machine code is never left pointing at freed instructions
+Code **compiled = NULL;
+int compiledCount = 0;
+int compiledCapacity = 0;
+
+// Grows the given array, if needed, so it has room for one more item
+void *reserveItem(void *items, int count, int *capacity, size_t size) {
+    if(count < *capacity) return items;
+    *capacity = *capacity ? *capacity * 2 : 64;
+    items = realloc(items, *capacity * size);
+    if(items == NULL) texit(1);
+    return items;
+}
+
+// Appends a byte to the code
+void emitByte(Assembler *a, uint8_t byte) {
+    if(a->length == a->capacity) {
+        a->capacity = a->capacity ? a->capacity * 2 : 4096;
+        a->bytes = realloc(a->bytes, a->capacity);
+        if(a->bytes == NULL) texit(1);
+    }
+    a->bytes[a->length++] = byte;
+}
+
+// Appends a 32-bit little endian number to the code
+void emitInt32(Assembler *a, int32_t n) {
+    for(int i = 0; i < 4; i++) emitByte(a, (uint32_t)n >> (8 * i));
+}
+
+// Appends a 64-bit little endian number to the code
+void emitInt64(Assembler *a, int64_t n) {
+    for(int i = 0; i < 8; i++) emitByte(a, (uint64_t)n >> (8 * i));
+}
+
+// Appends an opcode of one or two bytes
+void emitOpcode(Assembler *a, int opcode) {
+    if(opcode > 0xff) emitByte(a, opcode >> 8);
+    emitByte(a, opcode);
+}
+
+// Appends an instruction on reg, or the opcode extension reg, and the memory
+// at base + disp, with 64-bit operands if wide
+void emitMemory(Assembler *a, bool wide, int opcode, int reg, int base, int32_t disp) {
+    emitByte(a, 0x40 | wide << 3 | (reg >> 3) << 2 | base >> 3);
+    emitOpcode(a, opcode);
+    emitByte(a, 0x80 | (reg & 7) << 3 | (base & 7));
+    if((base & 7) == RSP) emitByte(a, 0x24);
+    emitInt32(a, disp);
+}
+
+// Appends an instruction on two 64-bit registers
+void emitRegisters(Assembler *a, int opcode, int reg, int rm) {
+    emitByte(a, 0x48 | (reg >> 3) << 2 | rm >> 3);
+    emitOpcode(a, opcode);
+    emitByte(a, 0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// Appends an ALU_IMM instruction with the given extension on a 64-bit
+// register and a 32-bit immediate
+void emitImmediate(Assembler *a, int extension, int reg, int32_t n) {
+    emitRegisters(a, ALU_IMM, extension, reg);
+    emitInt32(a, n);
+}
+
+// Loads a 64-bit register from base + disp
+void emitLoad(Assembler *a, int reg, int base, int32_t disp) {
+    emitMemory(a, true, MOV_LOAD, reg, base, disp);
+}
+
+// Stores a 64-bit register to base + disp
+void emitStore(Assembler *a, int reg, int base, int32_t disp) {
+    emitMemory(a, true, MOV_STORE, reg, base, disp);
+}
+
+// Copies one 64-bit register to another
+void emitMove(Assembler *a, int to, int from) {
+    emitRegisters(a, MOV_STORE, from, to);
+}
+
+// Loads a 64-bit register with a constant
+void emitConstant(Assembler *a, int reg, uint64_t n) {
+    emitByte(a, 0x48 | reg >> 3);
+    emitByte(a, 0xb8 | (reg & 7));
+    emitInt64(a, n);
+}
+
+// Sets the flags from the low bit of a register, which is set for fixnums
+void emitTestFixnum(Assembler *a, int reg) {
+    emitByte(a, 0x48 | reg >> 3);
+    emitByte(a, 0xf7);
+    emitByte(a, 0xc0 | (reg & 7));
+    emitInt32(a, FIXNUM_TAG);
+}
+
+// Compares the type field of the value a register points to with a type
+void emitCompareType(Assembler *a, int reg, valueType type) {
+    emitMemory(a, false, ALU_IMM, EXT_CMP, reg, offsetof(Value, type));
+    emitInt32(a, type);
+}
+
+// Calls a C function, whose arguments must already be in place. The machine
+// code keeps the C stack aligned for calls throughout.
+void emitCall(Assembler *a, void *function) {
+    emitConstant(a, RAX, (uintptr_t)function);
+    emitByte(a, 0xff);
+    emitByte(a, 0xd0);
+}
+
+// Jumps to the address in a register
+void emitJumpRegister(Assembler *a, int reg) {
+    if(reg >= R8) emitByte(a, 0x41);
+    emitByte(a, 0xff);
+    emitByte(a, 0xe0 | (reg & 7));
+}
+
+// Makes a new label, not yet placed
+int newLabel(Assembler *a) {
+    a->labels = reserveItem(a->labels, a->labelCount, &a->labelCapacity, sizeof(long));
+    a->labels[a->labelCount] = -1;
+    return a->labelCount++;
+}
+
+// Places the given label at the end of the code
+void placeLabel(Assembler *a, int label) {
+    a->labels[label] = a->length;
+}
+
+// Jumps to the given label, always or on the given condition
+void emitBranch(Assembler *a, int condition, int label) {
+    if(condition == CC_ALWAYS) emitByte(a, 0xe9);
+    else emitOpcode(a, 0x0f80 | condition);
+    a->patches = reserveItem(a->patches, a->patchCount, &a->patchCapacity, sizeof(Patch));
+    a->patches[a->patchCount].at = a->length;
+    a->patches[a->patchCount].label = label;
+    a->patchCount++;
+    emitInt32(a, 0);
+}
+
+// Returns a new label for code, placed after the function, that leaves to
+// the VM at ip, or causes the given evaluation error if ip is NULL
+int stubLabel(Assembler *a, uint32_t *ip, int error) {
+    a->stubs = reserveItem(a->stubs, a->stubCount, &a->stubCapacity, sizeof(Stub));
+    a->stubs[a->stubCount].label = newLabel(a);
+    a->stubs[a->stubCount].ip = ip;
+    a->stubs[a->stubCount].error = error;
+    return a->stubs[a->stubCount++].label;
+}
+
+// Pushes a register onto the value stack
+void emitPush(Assembler *a, int reg) {
+    emitStore(a, reg, SP, 0);
+    emitImmediate(a, EXT_ADD, SP, sizeof(Value *));
+}
+
+// Pops the value stack into a register
+void emitPop(Assembler *a, int reg) {
+    emitImmediate(a, EXT_SUB, SP, sizeof(Value *));
+    emitLoad(a, reg, SP, 0);
+}
+
+// Loads the stack pointer, frame and constants from the state
+void emitLoadState(Assembler *a) {
+    emitLoad(a, SP, STATE, offsetof(VMState, sp));
+    emitLoad(a, FRAME, STATE, offsetof(VMState, frame));
+    emitLoad(a, RCX, STATE, offsetof(VMState, code));
+    emitMemory(a, true, LEA, CONSTANTS, RCX, offsetof(Code, constants));
+}
+
+// Stores the stack pointer and frame in the state
+void emitSaveState(Assembler *a) {
+    emitStore(a, SP, STATE, offsetof(VMState, sp));
+    emitStore(a, FRAME, STATE, offsetof(VMState, frame));
+}
+
+// Hands the state to one of the VM's call or return functions, which takes
+// site and argc unless site is NULL, and goes on at the address it returns
+void emitTransfer(Assembler *a, void *function, uint32_t *site, int argc) {
+    emitSaveState(a);
+    emitMove(a, RDI, STATE);
+    if(site != NULL) {
+        emitConstant(a, RSI, (uintptr_t)site);
+        emitConstant(a, RDX, argc);
+    }
+    emitCall(a, function);
+    emitLoadState(a);
+    emitJumpRegister(a, RAX);
+}
+
+// Loads the frame the given number of levels up from the current one into a
+// register
+void emitFrameAt(Assembler *a, int reg, int depth) {
+    emitMove(a, reg, FRAME);
+    for(int i = 0; i < depth; i++) emitLoad(a, reg, reg, offsetof(Frame, parent));
+}
+
+// Returns the offset of the given slot in a frame
+int32_t slotOffset(int index) {
+    return offsetof(Frame, slots) + index * sizeof(Value *);
+}
+
+// Returns the offset of the given constant from the constants register
+int32_t constantOffset(int index) {
+    return index * sizeof(Value *);
+}
+
+// Pops the value stack into the slot or cell at disp in the object in rdi,
+// causing error 4 first if check is set and it's unassigned, and tells the
+// collector about the store
+void emitStoreInto(Assembler *a, int32_t disp, bool check) {
+    if(check) {
+        emitLoad(a, RAX, RDI, disp);
+        emitRegisters(a, TEST, RAX, RAX);
+        emitBranch(a, CC_E, stubLabel(a, NULL, 4));
+    }
+    emitPop(a, RSI);
+    emitStore(a, RSI, RDI, disp);
+    emitCall(a, gcWriteBarrier);
+}
+
+// Leaves rax as #t if the given condition holds and #f otherwise, using rsi
+void emitBool(Assembler *a, int condition) {
+    emitConstant(a, RAX, (uintptr_t)makeBool(false));
+    emitConstant(a, RSI, (uintptr_t)makeBool(true));
+    emitRegisters(a, CMOV(condition), RAX, RSI);
+}
+
+// Emits a cached fixnum instruction. The checks the VM makes are repeated,
+// and if any fails, or the result isn't a fixnum, the VM runs the
+// instruction instead.
+void emitFixnumOp(Assembler *a, opcode op, uint32_t *ip, bool tail) {
+    int slow = stubLabel(a, ip, 0);
+    emitLoad(a, RAX, SP, -3 * (int)sizeof(Value *));
+    emitTestFixnum(a, RAX);
+    emitBranch(a, CC_NE, slow);
+    emitCompareType(a, RAX, PRIMITIVE_TYPE);
+    emitBranch(a, CC_NE, slow);
+    emitByte(a, 0x66);
+    emitMemory(a, false, ALU_IMM, EXT_CMP, RAX, offsetof(Value, prim.fixnumOp));
+    emitByte(a, op);
+    emitByte(a, op >> 8);
+    emitBranch(a, CC_NE, slow);
+    emitLoad(a, RCX, SP, -2 * (int)sizeof(Value *));
+    emitLoad(a, RDX, SP, -1 * (int)sizeof(Value *));
+    emitMove(a, RAX, RCX);
+    emitRegisters(a, AND, RDX, RAX);
+    emitTestFixnum(a, RAX);
+    emitBranch(a, CC_E, slow);
+
+    // a fixnum n is 2n + 1, so the results are worked out on that form
+    // directly, and overflow there is overflow of the fixnum range
+    emitMove(a, RAX, RCX);
+    switch(op) {
+    case OP_ADD_FIXNUMS:
+        emitImmediate(a, EXT_SUB, RAX, 1);
+        emitRegisters(a, ADD, RDX, RAX);
+        emitBranch(a, CC_O, slow);
+        break;
+    case OP_SUBTRACT_FIXNUMS:
+        emitRegisters(a, SUB, RDX, RAX);
+        emitBranch(a, CC_O, slow);
+        emitImmediate(a, EXT_OR, RAX, 1);
+        break;
+    case OP_MULTIPLY_FIXNUMS:
+        emitByte(a, 0x48);
+        emitByte(a, 0xd1);
+        emitByte(a, 0xf8);
+        emitImmediate(a, EXT_SUB, RDX, 1);
+        emitRegisters(a, IMUL, RAX, RDX);
+        emitBranch(a, CC_O, slow);
+        emitImmediate(a, EXT_OR, RAX, 1);
+        break;
+    default: {
+        int condition = op == OP_LESS_FIXNUMS ? CC_L :
+            op == OP_GREATER_FIXNUMS ? CC_G :
+            op == OP_EQUAL_FIXNUMS ? CC_E :
+            op == OP_LESS_EQUAL_FIXNUMS ? CC_LE : CC_GE;
+        emitRegisters(a, CMP, RDX, RCX);
+        emitBool(a, condition);
+        break;
+    }
+    }
+    emitImmediate(a, EXT_SUB, SP, 2 * sizeof(Value *));
+    emitStore(a, RAX, SP, -1 * (int)sizeof(Value *));
+    if(tail) emitTransfer(a, vmReturn, NULL, 0);
+}
+
+// Emits a call of one argument that works out car, cdr or zero? of a pair or
+// fixnum in place when the callee is that primitive, and makes the call
+// otherwise
+void emitUnaryCall(Assembler *a, void *call, uint32_t *site, bool tail) {
+    int slow = newLabel(a);
+    int done = newLabel(a);
+    int isCar = newLabel(a);
+    int isCdr = newLabel(a);
+    int isZero = newLabel(a);
+    emitLoad(a, RAX, SP, -2 * (int)sizeof(Value *));
+    emitTestFixnum(a, RAX);
+    emitBranch(a, CC_NE, slow);
+    emitCompareType(a, RAX, PRIMITIVE_TYPE);
+    emitBranch(a, CC_NE, slow);
+    emitLoad(a, RCX, RAX, offsetof(Value, prim.function));
+    emitLoad(a, RDX, SP, -1 * (int)sizeof(Value *));
+    void *functions[] = {primitiveCar, primitiveCdr, primitiveIsZero};
+    int labels[] = {isCar, isCdr, isZero};
+    for(int i = 0; i < 3; i++) {
+        emitConstant(a, RSI, (uintptr_t)functions[i]);
+        emitRegisters(a, CMP, RSI, RCX);
+        emitBranch(a, CC_E, labels[i]);
+    }
+
+    placeLabel(a, slow);
+    emitTransfer(a, call, site, 1);
+
+    for(int i = 0; i < 2; i++) {
+        placeLabel(a, labels[i]);
+        emitTestFixnum(a, RDX);
+        emitBranch(a, CC_NE, slow);
+        emitCompareType(a, RDX, CONS_TYPE);
+        emitBranch(a, CC_NE, slow);
+        emitLoad(a, RAX, RDX, i == 0 ? offsetof(Value, c.car) : offsetof(Value, c.cdr));
+        emitBranch(a, CC_ALWAYS, done);
+    }
+    placeLabel(a, isZero);
+    emitTestFixnum(a, RDX);
+    emitBranch(a, CC_E, slow);
+    emitImmediate(a, EXT_CMP, RDX, (intptr_t)makeFixnum(0));
+    emitBool(a, CC_E);
+
+    placeLabel(a, done);
+    emitImmediate(a, EXT_SUB, SP, sizeof(Value *));
+    emitStore(a, RAX, SP, -1 * (int)sizeof(Value *));
+    if(tail) emitTransfer(a, vmReturn, NULL, 0);
+}
+
+// Emits the machine code for the instruction at the given index of the code
+void emitInstruction(Assembler *a, Code *code, int index) {
+    uint32_t *ip = code->ops + index;
+    uint32_t word = *ip;
+    int operand = word >> OPERAND_SHIFT;
+    opcode op = word & 0xff;
+    switch(op) {
+    case OP_CONSTANT:
+        emitLoad(a, RAX, CONSTANTS, constantOffset(operand));
+        emitPush(a, RAX);
+        break;
+    case OP_VOID:
+        emitConstant(a, RAX, (uintptr_t)makeVoid());
+        emitPush(a, RAX);
+        break;
+    case OP_LOCAL:
+        emitFrameAt(a, RAX, operand);
+        emitLoad(a, RAX, RAX, slotOffset(ip[1]));
+        emitRegisters(a, TEST, RAX, RAX);
+        emitBranch(a, CC_E, stubLabel(a, NULL, 4));
+        emitPush(a, RAX);
+        break;
+    case OP_LOCAL0:
+        emitLoad(a, RAX, FRAME, slotOffset(operand));
+        emitPush(a, RAX);
+        break;
+    case OP_LOCAL1:
+        emitLoad(a, RAX, FRAME, offsetof(Frame, parent));
+        emitLoad(a, RAX, RAX, slotOffset(operand));
+        emitPush(a, RAX);
+        break;
+    case OP_GLOBAL:
+        emitLoad(a, RAX, CONSTANTS, constantOffset(operand));
+        emitLoad(a, RAX, RAX, offsetof(Value, b.val));
+        emitRegisters(a, TEST, RAX, RAX);
+        emitBranch(a, CC_E, stubLabel(a, NULL, 4));
+        emitPush(a, RAX);
+        break;
+    case OP_STORE_LOCAL:
+    case OP_ASSIGN_LOCAL:
+        emitFrameAt(a, RDI, operand);
+        emitStoreInto(a, slotOffset(ip[1]), op == OP_ASSIGN_LOCAL);
+        break;
+    case OP_STORE_LOCAL0:
+        emitMove(a, RDI, FRAME);
+        emitStoreInto(a, slotOffset(operand), false);
+        break;
+    case OP_STORE_GLOBAL:
+    case OP_ASSIGN_GLOBAL:
+        emitLoad(a, RDI, CONSTANTS, constantOffset(operand));
+        emitStoreInto(a, offsetof(Value, b.val), op == OP_ASSIGN_GLOBAL);
+        break;
+    case OP_BOX:
+        emitMove(a, RDI, SP);
+        emitMove(a, RSI, FRAME);
+        emitConstant(a, RDX, operand);
+        emitCall(a, vmBox);
+        break;
+    case OP_UNBOX:
+        emitLoad(a, RAX, SP, -1 * (int)sizeof(Value *));
+        emitLoad(a, RAX, RAX, offsetof(Value, b.val));
+        emitRegisters(a, TEST, RAX, RAX);
+        emitBranch(a, CC_E, stubLabel(a, NULL, 4));
+        emitStore(a, RAX, SP, -1 * (int)sizeof(Value *));
+        break;
+    case OP_STORE_BOX:
+    case OP_ASSIGN_BOX:
+        emitPop(a, RDI);
+        emitStoreInto(a, offsetof(Value, b.val), op == OP_ASSIGN_BOX);
+        break;
+    case OP_POP:
+        emitImmediate(a, EXT_SUB, SP, sizeof(Value *));
+        break;
+    case OP_DUP:
+        emitLoad(a, RAX, SP, -1 * (int)sizeof(Value *));
+        emitPush(a, RAX);
+        break;
+    case OP_CHECK_BOOL: {
+        int error = stubLabel(a, NULL, operand);
+        emitLoad(a, RAX, SP, -1 * (int)sizeof(Value *));
+        emitTestFixnum(a, RAX);
+        emitBranch(a, CC_NE, error);
+        emitCompareType(a, RAX, BOOL_TYPE);
+        emitBranch(a, CC_NE, error);
+        break;
+    }
+    case OP_JUMP:
+        emitBranch(a, CC_ALWAYS, operand);
+        break;
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+        // #t is the only true boolean, so the test is one comparison
+        emitPop(a, RAX);
+        emitConstant(a, RCX, (uintptr_t)makeBool(true));
+        emitRegisters(a, CMP, RCX, RAX);
+        emitBranch(a, op == OP_JUMP_IF_FALSE ? CC_NE : CC_E, operand);
+        break;
+    case OP_ENTER:
+        emitMove(a, RDI, SP);
+        emitMove(a, RSI, FRAME);
+        emitConstant(a, RDX, operand);
+        emitConstant(a, RCX, ip[1]);
+        emitCall(a, vmEnterFrame);
+        emitMove(a, FRAME, RAX);
+        emitImmediate(a, EXT_SUB, SP, ip[1] * sizeof(Value *));
+        break;
+    case OP_LEAVE:
+        emitLoad(a, FRAME, FRAME, offsetof(Frame, parent));
+        break;
+    case OP_CLOSURE:
+        emitMove(a, RDI, SP);
+        emitLoad(a, RSI, CONSTANTS, constantOffset(operand));
+        emitConstant(a, RDX, ip[1]);
+        emitCall(a, vmMakeClosure);
+        emitImmediate(a, EXT_SUB, SP, ip[1] * sizeof(Value *));
+        emitPush(a, RAX);
+        break;
+    case OP_CAPTURE:
+        emitLoad(a, RDI, SP, -2 * (int)sizeof(Value *));
+        emitLoad(a, RDI, RDI, offsetof(Value, cl.frame));
+        emitStoreInto(a, slotOffset(operand), false);
+        emitImmediate(a, EXT_SUB, SP, sizeof(Value *));
+        break;
+    case OP_CALL:
+    case OP_TAILCALL: {
+        void *call = op == OP_CALL ? (void *)vmCall : (void *)vmTailCall;
+        if(CALL_ARGC(operand) == 1) emitUnaryCall(a, call, ip, op == OP_TAILCALL);
+        else emitTransfer(a, call, ip, CALL_ARGC(operand));
+        break;
+    }
+    case OP_ADD_FIXNUMS:
+    case OP_SUBTRACT_FIXNUMS:
+    case OP_MULTIPLY_FIXNUMS:
+    case OP_LESS_FIXNUMS:
+    case OP_GREATER_FIXNUMS:
+    case OP_EQUAL_FIXNUMS:
+    case OP_LESS_EQUAL_FIXNUMS:
+    case OP_GREATER_EQUAL_FIXNUMS:
+        emitFixnumOp(a, op, ip, operand);
+        break;
+    case OP_RETURN:
+        emitTransfer(a, vmReturn, NULL, 0);
+        break;
+    case OP_CHECK_RETURN:
+        emitMemory(a, false, MOV_IMM32, 0, STATE, offsetof(VMState, check));
+        emitInt32(a, operand);
+        break;
+    default:
+        // leave everything else to the VM, which comes back at the next call
+        // or return
+        emitBranch(a, CC_ALWAYS, stubLabel(a, ip, 0));
+        break;
+    }
+}
+
+// Returns the number of words the instruction at ip takes up
+int instructionLength(uint32_t *ip) {
+    switch(*ip & 0xff) {
+    case OP_LOCAL:
+    case OP_STORE_LOCAL:
+    case OP_ASSIGN_LOCAL:
+    case OP_ENTER:
+    case OP_CLOSURE:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// Copies the assembled code into memory of its own, which is made executable
+// once it's no longer writable, and returns its address, or NULL if there's
+// no memory for it
+uint8_t *install(Assembler *a) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (a->length + page - 1) / page * page;
+    uint8_t *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) return NULL;
+    memcpy(memory, a->bytes, a->length);
+    if(mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return NULL;
+    }
+    return memory;
+}
+
+// Writes a line naming the machine code at the given address to the perf map
+void nameCode(uint8_t *address, size_t size, char *name, void *code) {
+    if(perfMap == NULL) return;
+    fprintf(perfMap, "%lx %lx %s", (unsigned long)address, (unsigned long)size, name);
+    if(code != NULL) fprintf(perfMap, "@%p", code);
+    fprintf(perfMap, "\n");
+    fflush(perfMap);
+}
+
+// Frees what the assembler holds
+void freeAssembler(Assembler *a) {
+    free(a->bytes);
+    free(a->labels);
+    free(a->patches);
+    free(a->stubs);
+}
+
+// Visits every compiled function for the garbage collector
+void visitCompiled() {
+    for(int i = 0; i < compiledCount; i++) gcVisit((void **)&compiled[i]);
+}
+
+// Compiles the given code to machine code
+void jitCompile(Code *code) {
+    assert(jitEnabled);
+    Assembler a = {0};
+    for(int i = 0; i < code->length; i++) newLabel(&a);
+    for(int i = 0; i < code->length; i += instructionLength(code->ops + i)) {
+        placeLabel(&a, i);
+        emitInstruction(&a, code, i);
+    }
+
+    // the stubs that leave share the tail that stores ip and jumps to the
+    // exit, and the error stubs call evalError, which doesn't return
+    int leave = newLabel(&a);
+    for(int i = 0; i < a.stubCount; i++) {
+        placeLabel(&a, a.stubs[i].label);
+        if(a.stubs[i].ip != NULL) {
+            emitConstant(&a, RAX, (uintptr_t)a.stubs[i].ip);
+            emitBranch(&a, CC_ALWAYS, leave);
+        } else {
+            emitConstant(&a, RDI, a.stubs[i].error);
+            emitCall(&a, evalError);
+        }
+    }
+    placeLabel(&a, leave);
+    emitStore(&a, RAX, STATE, offsetof(VMState, ip));
+    emitConstant(&a, RAX, (uintptr_t)exitNative);
+    emitJumpRegister(&a, RAX);
+
+    for(int i = 0; i < a.patchCount; i++) {
+        long target = a.labels[a.patches[i].label];
+        assert(target >= 0);
+        int32_t offset = target - (long)(a.patches[i].at + 4);
+        memcpy(a.bytes + a.patches[i].at, &offset, 4);
+    }
+
+    uint8_t *machine = install(&a);
+    void **native = malloc(code->length * sizeof(void *));
+    if(machine == NULL || native == NULL) {
+        // leave the code to the VM for good
+        free(native);
+        freeAssembler(&a);
+        return;
+    }
+    for(int i = 0; i < code->length; i++) {
+        native[i] = a.labels[i] >= 0 ? machine + a.labels[i] : NULL;
+    }
+    nameCode(machine, a.length, "scheme-lambda", code);
+    freeAssembler(&a);
+
+    if(compiled == NULL) gcAddRoots(visitCompiled);
+    compiled = reserveItem(compiled, compiledCount, &compiledCapacity, sizeof(Code *));
+    compiled[compiledCount++] = code;
+    code->native = native;
+}
+
+// Builds the code that enters compiled code with the state in the registers
+// and the code that leaves it, and opens the perf map. Entering saves the
+// five registers the machine code uses, which with the return address keeps
+// the C stack aligned.
+bool jitInit() {
+    Assembler a = {0};
+    int saved[] = {RBX, R12, R13, R14, R15};
+    int savedCount = sizeof(saved) / sizeof(int);
+    for(int i = 0; i < savedCount; i++) {
+        if(saved[i] >= R8) emitByte(&a, 0x41);
+        emitByte(&a, 0x50 | (saved[i] & 7));
+    }
+    emitMove(&a, STATE, RDI);
+    emitLoadState(&a);
+    emitJumpRegister(&a, RSI);
+
+    size_t exitOffset = a.length;
+    emitSaveState(&a);
+    for(int i = savedCount - 1; i >= 0; i--) {
+        if(saved[i] >= R8) emitByte(&a, 0x41);
+        emitByte(&a, 0x58 | (saved[i] & 7));
+    }
+    emitByte(&a, 0xc3);
+
+    uint8_t *machine = install(&a);
+    if(machine == NULL) {
+        freeAssembler(&a);
+        return false;
+    }
+    enterNative = (void (*)(VMState *, void *))machine;
+    exitNative = machine + exitOffset;
+
+    char name[64];
+    snprintf(name, sizeof(name), "/tmp/perf-%d.map", (int)getpid());
+    perfMap = fopen(name, "w");
+    nameCode(machine, exitOffset, "scheme-jit-enter", NULL);
+    nameCode(machine + exitOffset, a.length - exitOffset, "scheme-jit-exit", NULL);
+    freeAssembler(&a);
+    jitEnabled = true;
+    return true;
+}
+
+// Runs compiled code from state's ip until it leaves to the VM
+void jitRun(VMState *state) {
+    Code *code = state->code;
+    assert(code->native[state->ip - code->ops] != NULL);
+    enterNative(state, code->native[state->ip - code->ops]);
+}
+
+// Returns the address to go on from at the given instruction
+void *jitResume(VMState *state, uint32_t *ip) {
+    Code *code = state->code;
+    if(ip != NULL && code->native != NULL) return code->native[ip - code->ops];
+    state->ip = ip;
+    return exitNative;
+}
+
+#else
+
+// Without machine code to compile to, the JIT never turns on
+
+bool jitInit() {
+    return false;
+}
+
+void jitCompile(Code *code) {
+    assert(!"the JIT isn't supported here");
+}
+
+void jitRun(VMState *state) {
+    assert(!"the JIT isn't supported here");
+}
+
+void *jitResume(VMState *state, uint32_t *ip) {
+    assert(!"the JIT isn't supported here");
+    return NULL;
+}
+
+#endif
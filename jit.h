@@ -0,0 +1,37 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "vm.h"
+
+#ifndef _JIT
+#define _JIT
+
+// The number of calls after which a function is compiled to machine code
+#ifndef JIT_THRESHOLD
+#define JIT_THRESHOLD 100
+#endif
+
+// Whether hot functions are compiled, which only happens after jitInit
+extern bool jitEnabled;
+
+// Turns the JIT on and returns true, or returns false if it can't run here.
+// It only runs on x86-64 Linux; elsewhere the VM runs everything.
+bool jitInit();
+
+// Compiles the given code to machine code, which the VM then runs in its
+// place. The machine code handles the instructions that stay within the
+// function itself and hands calls and returns to the VM. If it can't be
+// compiled, the code is left to the VM.
+void jitCompile(Code *code);
+
+// Runs the compiled code of state's function from state's ip, which must be
+// the start of an instruction, until it leaves to the VM, and updates state
+// to where it left
+void jitRun(VMState *state);
+
+// Returns the machine code address of the given instruction of state's
+// function if it has been compiled, and otherwise sets state's ip to it and
+// returns the address that leaves to the VM. A NULL ip leaves to the VM to
+// return from vmRun.
+void *jitResume(VMState *state, uint32_t *ip);
+
+#endif
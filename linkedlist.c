@@ -1,227 +1,348 @@
-#include <stdbool.h>
-#include <stdio.h>
-#include <assert.h>
-#include <stdlib.h>
-#include <string.h>
-#include "value.h"
-#include "talloc.h"
-#include "interpreter.h"
-#include "linkedlist.h"
-
-// Helper function to get the car of a "cons cell"
-Value *car(Value *list) {
-    assert(list);
-    assert(list->type == CONS_TYPE);
-    return list->c.car;
-}
-
-// Helper function to get the cdr of a "cons cell"
-Value *cdr(Value *list) {
-    assert(list);
-    assert(list->type == CONS_TYPE);
-    return list->c.cdr;
-}
-
-// Helper function to get the variable of a binding
-Value *var(Value *binding) {
-    assert(binding);
-    assert(binding->type == BINDING_TYPE);
-    return binding->b.var;
-}
-
-// Helper function to get the value of a binding
-Value *val(Value *binding) {
-    assert(binding);
-    assert(binding->type == BINDING_TYPE);
-    return binding->b.val;
-}
-
-// Helper function to set the car of a "cons cell"
-void setCar(Value *list, Value *newCar) {
-    assert(list);
-    assert(list->type == CONS_TYPE);
-    list->c.car = newCar;
-}
-
-// Helper function to set the cdr of a "cons cell"
-void setCdr(Value *list, Value *newCdr) {
-    assert(list);
-    assert(list->type == CONS_TYPE);
-    list->c.cdr = newCdr;
-}
-
-// Helper function to check if the given value is a null value node
-bool isNull(Value *value) {
-    assert(value);
-    if(value->type == NULL_TYPE) return true;
-    return false;
-}
-
-// Returns the length of the list
-int length(Value *value) {
-    assert(value);
-    Value *cur = value;
-    int len = 0;
-    while(!isNull(cur)) {
-        assert(cur->type == CONS_TYPE);
-        len++;
-        cur = cdr(cur);
-    }
-    return len;
-}
-
-// Create a new NULL_TYPE value node
-Value *makeNull() {
-    Value *nullValue = (Value *)talloc(sizeof(Value));
-    nullValue->type = NULL_TYPE;
-    return nullValue;
-}
-
-// Creates a BINDING_TYPE Value node
-Value *makeBinding(Value *var, Value *val) {
-    assert(var);
-    assert(val);
-    Value *newBinding = (Value *)talloc(sizeof(Value));
-    newBinding->type = BINDING_TYPE;
-    newBinding->b.var = var;
-    newBinding->b.val = val;
-    return newBinding;
-}
-
-// Creates a VOID_TYPE Value node
-Value *makeVoid() {
-    Value *voidValue = (Value *)talloc(sizeof(Value));
-    voidValue->type = VOID_TYPE;
-    return voidValue;
-}
-
-// Creates a closure type Value node
-Value *makeClosure(Value *paramNames, Value *functionCode, Frame *frame) {
-    assert(paramNames);
-    assert(functionCode);
-    assert(frame);
-    Value *closure = (Value *)talloc(sizeof(Value));
-    closure->type = CLOSURE_TYPE;
-    closure->cl.paramNames = paramNames;
-    closure->cl.functionCode = functionCode;
-    Frame *newFrame = (Frame *)talloc(sizeof(Frame));
-    newFrame->parent = frame;
-    closure->cl.frame = newFrame;
-    return closure;
-}
-
-// Create a new CONS_TYPE value node
-Value *cons(Value *car, Value *cdr) {
-    assert(car);
-    assert(cdr);
-    Value *consValue = (Value *)talloc(sizeof(Value));
-    consValue->type = CONS_TYPE;
-    setCar(consValue, car);
-    setCdr(consValue, cdr);
-    return consValue;
-}
-
-// Helper function to print a boolean
-void displayBool(Value *boolVal) {
-    assert(boolVal);
-    assert(boolVal->type == BOOL_TYPE);
-    if(boolVal->i) printf("#t");
-    else printf("#f");
-}
-
-// Helper function to display a binding
-void displayBinding(Value *binding) {
-    assert(binding);
-    assert(binding->type == BINDING_TYPE);
-    printf("[");
-    displayList(var(binding), false);
-    printf(" = ");
-    displayList(val(binding), false);
-    printf("]");
-}
-
-// Helper function to display nested lists
-void displayNestedList(Value *list) {
-    assert(list);
-    assert(list->type == CONS_TYPE);
-    bool print = (car(list))->type == CONS_TYPE;
-    bool space = !isNull(cdr(list));
-    if(print) printf("(");
-    displayList(car(list), space);
-    if(print) {
-        if(space) printf(") ");
-        else printf(")");
-    }
-    if(space) {
-        if((cdr(list))->type != CONS_TYPE) printf(". ");
+#include <stdbool.h>
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "value.h"
+#include "talloc.h"
+#include "gc.h"
+#include "interpreter.h"
+#include "linkedlist.h"
+#include "number.h"
+#include "text.h"
+#include "output.h"
+
+// The number of nested lists and vectors that displayList keeps track of
+// before it moves its stack to the heap
+#define NESTING_STACK_SIZE 64
+
+// The only null, void and boolean values. They live outside the collected
+// heap, which ignores pointers to them, and must never be modified.
+Value nullValue = {.type = NULL_TYPE};
+Value voidValue = {.type = VOID_TYPE};
+Value trueValue = {.type = BOOL_TYPE, .i = 1};
+Value falseValue = {.type = BOOL_TYPE, .i = 0};
+
+// Helper function to get the car of a "cons cell"
+Value *car(Value *list) {
+    assert(list);
+    assert(typeOf(list) == CONS_TYPE);
+    return list->c.car;
+}
+
+// Helper function to get the cdr of a "cons cell"
+Value *cdr(Value *list) {
+    assert(list);
+    assert(typeOf(list) == CONS_TYPE);
+    return list->c.cdr;
+}
+
+// Helper function to get the variable of a binding
+Value *var(Value *binding) {
+    assert(binding);
+    assert(typeOf(binding) == BINDING_TYPE);
+    return binding->b.var;
+}
+
+// Helper function to get the value of a binding
+Value *val(Value *binding) {
+    assert(binding);
+    assert(typeOf(binding) == BINDING_TYPE);
+    return binding->b.val;
+}
+
+// Helper function to set the car of a "cons cell"
+void setCar(Value *list, Value *newCar) {
+    assert(list);
+    assert(typeOf(list) == CONS_TYPE);
+    list->c.car = newCar;
+    gcWriteBarrier(list, newCar);
+}
+
+// Helper function to set the cdr of a "cons cell"
+void setCdr(Value *list, Value *newCdr) {
+    assert(list);
+    assert(typeOf(list) == CONS_TYPE);
+    list->c.cdr = newCdr;
+    gcWriteBarrier(list, newCdr);
+}
+
+// Helper function to check if the given value is the null value
+bool isNull(Value *value) {
+    assert(value);
+    return value == &nullValue;
+}
+
+// Returns the length of the list
+int length(Value *value) {
+    assert(value);
+    Value *cur = value;
+    int len = 0;
+    while(!isNull(cur)) {
+        assert(typeOf(cur) == CONS_TYPE);
+        len++;
+        cur = cdr(cur);
+    }
+    return len;
+}
+
+// Returns the null value
+Value *makeNull() {
+    return &nullValue;
+}
+
+// Returns the boolean value for the given bool
+Value *makeBool(bool b) {
+    return b ? &trueValue : &falseValue;
+}
+
+// Creates a DOUBLE_TYPE Value node
+Value *makeDouble(double d) {
+    Value *doubleValue = gcAllocValue();
+    doubleValue->type = DOUBLE_TYPE;
+    doubleValue->d = d;
+    return doubleValue;
+}
+
+// Creates a BINDING_TYPE Value node
+Value *makeBinding(Value *var, Value *val) {
+    assert(var);
+    assert(val);
+    Value *newBinding = gcAllocValue();
+    newBinding->type = BINDING_TYPE;
+    newBinding->b.var = var;
+    newBinding->b.val = val;
+    return newBinding;
+}
+
+// Returns the void value
+Value *makeVoid() {
+    return &voidValue;
+}
+
+// Creates a closure type Value node
+Value *makeClosure(struct Code *code, Frame *frame) {
+    assert(code);
+    Value *closure = gcAllocValue();
+    closure->type = CLOSURE_TYPE;
+    closure->cl.code = code;
+    closure->cl.frame = frame;
+    return closure;
+}
+
+// Creates a VECTOR_TYPE Value node of the given length with every element
+// set to fill. The elements are allocated first, so the vector is never older
+// than them.
+Value *makeVector(int length, Value *fill) {
+    assert(length >= 0);
+    assert(fill);
+    Value **items = gcAllocArray(length);
+    for(int i = 0; i < length; i++) items[i] = fill;
+    Value *vector = gcAllocValue();
+    vector->type = VECTOR_TYPE;
+    vector->vec.length = length;
+    vector->vec.items = items;
+    return vector;
+}
+
+// Creates a VECTOR_TYPE Value node holding the elements of the given list
+Value *listToVector(Value *list) {
+    assert(list);
+    Value *vector = makeVector(length(list), makeNull());
+    for(int i = 0; !isNull(list); i++, list = cdr(list)) {
+        vector->vec.items[i] = car(list);
+        gcWriteBarrier(vector->vec.items, car(list));
+    }
+    return vector;
+}
+
+// Returns a new list of the elements of the given vector
+Value *vectorToList(Value *vector) {
+    assert(vector);
+    assert(typeOf(vector) == VECTOR_TYPE);
+    Value *list = makeNull();
+    for(int i = vector->vec.length - 1; i >= 0; i--) list = cons(vector->vec.items[i], list);
+    return list;
+}
+
+// Create a new CONS_TYPE value node
+Value *cons(Value *car, Value *cdr) {
+    assert(car);
+    assert(cdr);
+    Value *consValue = gcAllocValue();
+    consValue->type = CONS_TYPE;
+    setCar(consValue, car);
+    setCdr(consValue, cdr);
+    return consValue;
+}
+
+// Helper function to print a boolean
+void displayBool(Value *boolVal) {
+    assert(boolVal);
+    assert(typeOf(boolVal) == BOOL_TYPE);
+    if(boolVal->i) outputString("#t");
+    else outputString("#f");
+}
+
+// Helper function to display a binding
+void displayBinding(Value *binding) {
+    assert(binding);
+    assert(typeOf(binding) == BINDING_TYPE);
+    outputChar('[');
+    displayList(var(binding), false);
+    outputString(" = ");
+    displayList(val(binding), false);
+    outputChar(']');
+}
+
+// Returns a heap copy of the given stack of capacity entries with room for
+// twice as many, freeing the old one unless it's the local array
+Value **growNestingStack(Value **stack, Value **local, int *capacity) {
+    Value **grown = (Value **)malloc(*capacity * 2 * sizeof(Value *));
+    if(grown == NULL) texit(1);
+    memcpy(grown, stack, *capacity * sizeof(Value *));
+    if(stack != local) free(stack);
+    *capacity *= 2;
+    return grown;
+}
+
+// Helper function to display a value that has no parts to display: anything
+// but a pair or a vector with elements. Void displays as nothing.
+void displayAtom(Value *value) {
+    valueType type = typeOf(value);
+    if(type == INT_TYPE || type == BIGNUM_TYPE) displayInteger(value);
+    else if (type == DOUBLE_TYPE) outputDouble(value->d);
+    else if(type == NULL_TYPE) outputString("()");
+    else if(type == PTR_TYPE) outputPointer(value->p);
+    else if(type == CLOSURE_TYPE) outputString("closure");
+    else if(type == HASH_TABLE_TYPE) outputString("hash-table");
+    else if(type == BOOL_TYPE) displayBool(value);
+    else if(type == BINDING_TYPE) displayBinding(value);
+    else if(type == VECTOR_TYPE) outputString("#()");
+    else if(type == STRING_PORT_TYPE) outputString("string-port");
+    else if(type == STR_TYPE) {
+        outputChar('\"');
+        outputChars(stringChars(value), value->str.length);
+        outputChar('\"');
+    }
+    else if (type == OPEN_TYPE || type == CLOSE_TYPE || type == SYMBOL_TYPE) {
+        outputString(value->s);
+    }
+}
+
+// Helper function to display a list of value nodes. The elements of a list
+// are separated by spaces, with a dot before an improper tail, and elements
+// that are lists are put in parentheses; a vector is displayed the same way
+// between #( and ). A value that isn't a list is followed by a space if
+// addSpace is set.
+// Each list or vector being displayed has an entry on a stack of its own
+// instead of a C stack frame, so no amount of nesting can overflow the C
+// stack. An entry is the container and a fixnum saying which part of it is
+// being displayed: the car or the cdr of a list cell, or the index of a
+// vector element. The cdrs of a list replace its cell in the entry, so a
+// long list only needs one.
+void displayList(Value *list, bool addSpace) {
+    assert(list);
+    Value *local[2 * NESTING_STACK_SIZE];
+    Value **stack = local;
+    int depth = 0;
+    int capacity = 2 * NESTING_STACK_SIZE;
+    Value *value = list;
+    for(;;) {
+        // Start on the value, going down into the first part of each list or
+        // vector until there's an atom to display
+        for(;;) {
+            valueType type = typeOf(value);
+            if(type != CONS_TYPE && (type != VECTOR_TYPE || value->vec.length == 0)) {
+                displayAtom(value);
+                break;
+            }
+            if(depth == capacity) stack = growNestingStack(stack, local, &capacity);
+            stack[depth++] = value;
+            stack[depth++] = makeFixnum(0);
+            if(type == VECTOR_TYPE) outputString("#(");
+            value = type == CONS_TYPE ? car(value) : value->vec.items[0];
+            if(typeOf(value) == CONS_TYPE) outputChar('(');
+        }
+        // Finish the containers that the value was the last part of, until
+        // one has another part to start on
+        for(;;) {
+            if(depth == 0) {
+                if(stack != local) free(stack);
+                if(addSpace && typeOf(list) != CONS_TYPE && typeOf(list) != VOID_TYPE) {
+                    outputChar(' ');
+                }
+                return;
+            }
+            Value *container = stack[depth - 2];
+            int part = fixnumValue(stack[depth - 1]);
+            bool tail = typeOf(container) == CONS_TYPE && part == 1;
+            bool last;
+            if(typeOf(container) == CONS_TYPE) last = tail || isNull(cdr(container));
+            else last = part == container->vec.length - 1;
+            if(typeOf(value) == CONS_TYPE && !tail) outputString(last ? ")" : ") ");
+            else if(!last && typeOf(value) != VOID_TYPE) outputChar(' ');
+            if(last) {
+                depth -= 2;
+                if(typeOf(container) == VECTOR_TYPE) outputChar(')');
+                value = container;
+            } else if(typeOf(container) == VECTOR_TYPE) {
+                stack[depth - 1] = makeFixnum(part + 1);
+                value = container->vec.items[part + 1];
+                break;
+            } else if(typeOf(cdr(container)) == CONS_TYPE) {
+                stack[depth - 2] = cdr(container);
+                value = car(cdr(container));
+                break;
+            } else {
+                outputString(". ");
+                stack[depth - 1] = makeFixnum(1);
+                value = cdr(container);
+                break;
+            }
+        }
+        if(typeOf(value) == CONS_TYPE) outputChar('(');
+    }
+}
+
+// Displays the given list on one line with parentheses denoting lists
+void display(Value *list) {
+    assert(list);
+    if(typeOf(list) == CONS_TYPE) {
+        bool space = !isNull(cdr(list));
+        outputChar('(');
+        displayList(car(list), space);
+        if(typeOf(cdr(list)) != CONS_TYPE) outputString(". ");
         displayList(cdr(list), false);
-    }
-}
-
-// Helper function to display a list of value nodes
-void displayList(Value *list, bool addSpace) {
-    assert(list);
-    if(list->type == VOID_TYPE) return;
-    if(list->type != CONS_TYPE) {
-        if(list->type == INT_TYPE) printf("%i", list->i);
-        else if (list->type == DOUBLE_TYPE) printf("%f", list->d);
-        else if(list->type == NULL_TYPE) printf("()");
-        else if(list->type == PTR_TYPE) printf("%p", list->p);
-        else if(list->type == CLOSURE_TYPE) printf("closure");
-        else if(list->type == BOOL_TYPE) displayBool(list);
-        else if(list->type == BINDING_TYPE) displayBinding(list);
-        else if (list->type == STR_TYPE || list->type == OPEN_TYPE ||
-            list->type == CLOSE_TYPE || list->type == SYMBOL_TYPE) {
-            printf("%s", list->s);
-        }
-        if(addSpace) printf(" ");
-    }
-    else displayNestedList(list);
-}
-
-// Displays the given list on one line with parentheses denoting lists
-void display(Value *list) {
-    assert(list);
-    if(list->type == CONS_TYPE) {
-        bool space = !isNull(cdr(list));
-        printf("(");
-        displayList(car(list), space);
-        if((cdr(list))->type != CONS_TYPE) printf(". ");
-        displayList(cdr(list), false);
-        printf(") ");
-    } else displayList(list, true);
-}
-
-// Helper method to copy a CONS_TYPE Value node
-Value *copyConsValue(Value *val) {
-    assert(val);
-    assert(val->type == CONS_TYPE || isNull(val));
-    Value *copy = (Value *)talloc(sizeof(Value));
-    copy->type = val->type;
-    if(!isNull(val)) {
-        setCar(copy, car(val));
-        setCdr(copy, cdr(val));
-    }
-    return copy;
-}
-
-// Reverses the given list
-Value *reverse(Value *list) {
-    assert(list);
-    if(isNull(list)) return list;
-    assert(list->type == CONS_TYPE);
-    Value *cur = copyConsValue(list);
-    Value *next = copyConsValue(cdr(cur));
-    Value *prev;
-    setCdr(cur, makeNull());
-    prev = cur;
-    cur = next;
-    while(!isNull(cur)) {
-        assert(cur->type == CONS_TYPE);
-        next = copyConsValue(cdr(cur));
-        setCdr(cur, prev);
-        prev = cur;
-        cur = next;
-    }
-    return prev;
-}
+        outputString(") ");
+    } else displayList(list, true);
+}
+
+// Helper method to copy a CONS_TYPE Value node
+Value *copyConsValue(Value *val) {
+    assert(val);
+    assert(typeOf(val) == CONS_TYPE || isNull(val));
+    if(isNull(val)) return val;
+    return cons(car(val), cdr(val));
+}
+
+// Reverses the given list
+Value *reverse(Value *list) {
+    assert(list);
+    if(isNull(list)) return list;
+    assert(typeOf(list) == CONS_TYPE);
+    Value *cur = copyConsValue(list);
+    Value *next = copyConsValue(cdr(cur));
+    Value *prev;
+    setCdr(cur, makeNull());
+    prev = cur;
+    cur = next;
+    while(!isNull(cur)) {
+        assert(typeOf(cur) == CONS_TYPE);
+        next = copyConsValue(cdr(cur));
+        setCdr(cur, prev);
+        prev = cur;
+        cur = next;
+    }
+    return prev;
+}
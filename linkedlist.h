@@ -4,9 +4,26 @@
 #ifndef _LINKEDLIST
 #define _LINKEDLIST
 
-// Create a new NULL_TYPE value node.
+// Returns the null value. There is only one, so it can be compared by address.
 Value *makeNull();
 
+// Returns #t or #f. There is only one of each.
+Value *makeBool(bool b);
+
+// Create a new DOUBLE_TYPE value node.
+Value *makeDouble(double d);
+
+// Creates a VECTOR_TYPE value node of the given length with every element set
+// to fill.
+Value *makeVector(int length, Value *fill);
+
+// Creates a VECTOR_TYPE value node holding the elements of the given list,
+// which must be a proper list.
+Value *listToVector(Value *list);
+
+// Returns a new list of the elements of the given vector.
+Value *vectorToList(Value *vector);
+
 // Create a new CONS_TYPE value node.
 Value *cons(Value *newCar, Value *newCdr);
 
@@ -16,6 +33,13 @@ void display(Value *list);
 // Helper function to display a list of value nodes
 void displayList(Value *list, bool addSpace);
 
+// Returns a copy on the heap of the given stack of Values, which has capacity
+// entries, with room for twice as many, and doubles capacity. The old stack
+// is freed unless it's local, the array on the C stack that it started in.
+// This lets walks over nested lists keep their own stack instead of
+// recursing.
+Value **growNestingStack(Value **stack, Value **local, int *capacity);
+
 // Return a new list that is the reverse of the one that is passed in. No stored
 // data within the linked list should be duplicated; rather, a new linked list
 // of CONS_TYPE nodes should be created, that point to items in the original
@@ -45,11 +69,12 @@ Value *val(Value *binding);
 // Creates a BINDING_TYPE Value node
 Value *makeBinding(Value *var, Value *val);
 
-// Creates a VOID_TYPE Value node
+// Returns the void value. There is only one.
 Value *makeVoid();
 
-// Creates a closure type Value node
-Value *makeClosure(Value *paramNames, Value *functionCode, struct Frame *frame);
+// Creates a closure type Value node for the given compiled lambda body and
+// the frame holding the values it captures, or NULL if it captures none
+Value *makeClosure(struct Code *code, struct Frame *frame);
 
 // Utility to check if pointing to a NULL_TYPE value. Use assertions to make sure
 // that this is a legitimate operation.
@@ -1,17 +1,37 @@
 #include <stdio.h>
-#include "tokenizer.h"
+#include <string.h>
+#include "source.h"
+#include "scan.h"
 #include "value.h"
 #include "linkedlist.h"
 #include "parser.h"
 #include "talloc.h"
+#include "gc.h"
 #include "interpreter.h"
+#include "optimizer.h"
+#include "jit.h"
 
-int main() {
+int main(int argc, char *argv[]) {
+    gcInit(__builtin_frame_address(0));
+    bool printStats = false;
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--gc-stats")) printStats = true;
+        else if(!strcmp(argv[i], "--jit")) {
+            if(!jitInit()) fprintf(stderr, "The JIT can't run here, so it's off\n");
+        } else if(!strcmp(argv[i], "--dump-optimized")) dumpOptimized = true;
+        else {
+            printf("Usage: %s [--gc-stats] [--jit] [--dump-optimized] < program.scm\n", argv[0]);
+            return 1;
+        }
+    }
 
-    Value *list = tokenize(stdin);
-    Value *tree = parse(list);
-    interpret(tree);
+    initScanner(AVX2_SCAN);
+    Source source;
+    openSource(&source, fileno(stdin));
+    interpretSource(&source);
 
+    if(printStats) gcPrintStats(stderr);
     tfree();
+    closeSource(&source);
     return 0;
 }
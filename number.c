@@ -0,0 +1,537 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "gc.h"
+#include "number.h"
+#include "output.h"
+
+// Below this many digits the schoolbook multiplication is faster than
+// Karatsuba's
+#define KARATSUBA_THRESHOLD 32
+
+// The largest power of ten that fits in a digit, used to convert to and from
+// decimal nine places at a time
+#define DECIMAL_BASE 1000000000u
+#define DECIMAL_PLACES 9
+
+// An integer of either representation seen as a sign and a magnitude. The
+// digits of a fixnum are kept in small, so an Integer must not be copied.
+typedef struct Integer Integer;
+struct Integer {
+    int sign;
+    int length;
+    uint32_t *digits;
+    uint32_t small[2];
+};
+
+// Returns a zeroed buffer for the given number of digits. Results are worked
+// out in these buffers outside of the collected heap, so that nothing moves
+// while they are being computed.
+uint32_t *newDigits(int length) {
+    uint32_t *digits = calloc(length > 0 ? length : 1, sizeof(uint32_t));
+    if(digits == NULL) texit(1);
+    return digits;
+}
+
+// Fills in n with the sign and magnitude of the given integer
+void viewInteger(Value *value, Integer *n) {
+    assert(isExact(value));
+    if(isFixnum(value)) {
+        intptr_t i = fixnumValue(value);
+        uint64_t magnitude = i < 0 ? -(uint64_t)i : (uint64_t)i;
+        n->sign = i < 0 ? -1 : 1;
+        n->small[0] = (uint32_t)magnitude;
+        n->small[1] = (uint32_t)(magnitude >> 32);
+        n->length = n->small[1] ? 2 : n->small[0] ? 1 : 0;
+        n->digits = n->small;
+    } else {
+        n->sign = value->big.sign;
+        n->length = value->big.length;
+        n->digits = value->big.digits;
+    }
+}
+
+// Returns the given number of digits without the leading zeros
+int trimDigits(uint32_t *digits, int length) {
+    while(length > 0 && digits[length - 1] == 0) length--;
+    return length;
+}
+
+// Returns the integer with the given sign and the magnitude in the given
+// buffer, which is freed. The result is a fixnum whenever it fits in one.
+Value *finishInteger(int sign, uint32_t *digits, int length) {
+    length = trimDigits(digits, length);
+    if(length <= 2) {
+        uint64_t magnitude = digits[0];
+        if(length == 2) magnitude |= (uint64_t)digits[1] << 32;
+        if(sign > 0 && magnitude <= (uint64_t)FIXNUM_MAX) {
+            free(digits);
+            return makeFixnum((intptr_t)magnitude);
+        }
+        if(sign < 0 && magnitude <= (uint64_t)FIXNUM_MAX + 1) {
+            free(digits);
+            return makeFixnum(-(intptr_t)(magnitude - 1) - 1);
+        }
+    }
+    uint32_t *copy = gcAlloc(length * sizeof(uint32_t), RAW_OBJECT);
+    memcpy(copy, digits, length * sizeof(uint32_t));
+    free(digits);
+    Value *bignum = gcAllocValue();
+    bignum->type = BIGNUM_TYPE;
+    bignum->big.sign = sign;
+    bignum->big.length = length;
+    bignum->big.digits = copy;
+    return bignum;
+}
+
+// Returns the integer with the given value
+Value *makeInteger(intptr_t n) {
+    if(n >= FIXNUM_MIN && n <= FIXNUM_MAX) return makeFixnum(n);
+    uint64_t magnitude = n < 0 ? -(uint64_t)n : (uint64_t)n;
+    uint32_t *digits = newDigits(2);
+    digits[0] = (uint32_t)magnitude;
+    digits[1] = (uint32_t)(magnitude >> 32);
+    return finishInteger(n < 0 ? -1 : 1, digits, 2);
+}
+
+// Compares the magnitudes of two trimmed numbers, returning a negative number,
+// zero or a positive number as a is less than, equal to or greater than b
+int compareDigits(uint32_t *a, int aLength, uint32_t *b, int bLength) {
+    if(aLength != bLength) return aLength < bLength ? -1 : 1;
+    for(int i = aLength - 1; i >= 0; i--) {
+        if(a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// Stores a + b in result, which must have room for one more digit than the
+// longer of the two, and returns the number of digits used
+int addDigits(uint32_t *result, uint32_t *a, int aLength, uint32_t *b, int bLength) {
+    if(aLength < bLength) return addDigits(result, b, bLength, a, aLength);
+    uint64_t carry = 0;
+    for(int i = 0; i < aLength; i++) {
+        carry += a[i];
+        if(i < bLength) carry += b[i];
+        result[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    result[aLength] = (uint32_t)carry;
+    return aLength + 1;
+}
+
+// Stores a - b in result, which must have as many digits as a. The magnitude
+// of a must be at least that of b. Returns the number of digits used.
+int subtractDigits(uint32_t *result, uint32_t *a, int aLength, uint32_t *b, int bLength) {
+    uint64_t borrow = 0;
+    for(int i = 0; i < aLength; i++) {
+        uint64_t difference = (uint64_t)a[i] - borrow;
+        if(i < bLength) difference -= b[i];
+        result[i] = (uint32_t)difference;
+        borrow = difference >> 63;
+    }
+    assert(borrow == 0);
+    return aLength;
+}
+
+// Adds b into the given number of digits of result. The sum must fit.
+void addInto(uint32_t *result, int length, uint32_t *b, int bLength) {
+    uint64_t carry = 0;
+    for(int i = 0; i < length && (i < bLength || carry); i++) {
+        carry += result[i];
+        if(i < bLength) carry += b[i];
+        result[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    assert(carry == 0);
+}
+
+// Subtracts b from the given number of digits of result, which must be at
+// least as large
+void subtractFrom(uint32_t *result, int length, uint32_t *b, int bLength) {
+    uint64_t borrow = 0;
+    for(int i = 0; i < length && (i < bLength || borrow); i++) {
+        uint64_t difference = (uint64_t)result[i] - borrow;
+        if(i < bLength) difference -= b[i];
+        result[i] = (uint32_t)difference;
+        borrow = difference >> 63;
+    }
+    assert(borrow == 0);
+}
+
+// Adds a * b into result, which must have aLength + bLength digits
+void multiplySchoolbook(uint32_t *result, uint32_t *a, int aLength, uint32_t *b, int bLength) {
+    for(int i = 0; i < aLength; i++) {
+        uint64_t digit = a[i];
+        if(digit == 0) continue;
+        uint64_t carry = 0;
+        for(int j = 0; j < bLength; j++) {
+            carry += digit * b[j] + result[i + j];
+            result[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        result[i + bLength] = (uint32_t)carry;
+    }
+}
+
+// Stores a * b in result, which must have aLength + bLength zeroed digits.
+// Large operands are split in halves so that three multiplications of half
+// the size do the work of four, as Karatsuba found.
+void multiplyDigits(uint32_t *result, uint32_t *a, int aLength, uint32_t *b, int bLength) {
+    if(aLength < bLength) {
+        multiplyDigits(result, b, bLength, a, aLength);
+        return;
+    }
+    if(bLength < KARATSUBA_THRESHOLD) {
+        multiplySchoolbook(result, a, aLength, b, bLength);
+        return;
+    }
+
+    // when a is much longer than b, multiply b by one b-sized slice of a at
+    // a time, so that the splits below stay balanced
+    if(aLength >= 2 * bLength) {
+        uint32_t *product = newDigits(2 * bLength);
+        for(int i = 0; i < aLength; i += bLength) {
+            int sliceLength = aLength - i < bLength ? aLength - i : bLength;
+            memset(product, 0, 2 * bLength * sizeof(uint32_t));
+            multiplyDigits(product, a + i, sliceLength, b, bLength);
+            addInto(result + i, aLength + bLength - i, product, sliceLength + bLength);
+        }
+        free(product);
+        return;
+    }
+
+    // a = a1 * B^half + a0 and b = b1 * B^half + b0, so a * b is
+    // low + (middle - low - high) * B^half + high * B^(2 half) with
+    // low = a0 * b0, high = a1 * b1 and middle = (a0 + a1) * (b0 + b1)
+    int half = aLength / 2;
+    int highLength = aLength + bLength - 2 * half;
+    uint32_t *low = newDigits(2 * half);
+    uint32_t *high = newDigits(highLength);
+    multiplyDigits(low, a, half, b, half);
+    multiplyDigits(high, a + half, aLength - half, b + half, bLength - half);
+
+    uint32_t *aSum = newDigits(aLength - half + 1);
+    uint32_t *bSum = newDigits(aLength - half + 1);
+    int aSumLength = addDigits(aSum, a, half, a + half, aLength - half);
+    int bSumLength = addDigits(bSum, b, half, b + half, bLength - half);
+    int middleLength = aSumLength + bSumLength;
+    uint32_t *middle = newDigits(middleLength);
+    multiplyDigits(middle, aSum, aSumLength, bSum, bSumLength);
+    subtractFrom(middle, middleLength, low, 2 * half);
+    subtractFrom(middle, middleLength, high, highLength);
+
+    addInto(result, aLength + bLength, low, 2 * half);
+    addInto(result + half, aLength + bLength - half, middle,
+        trimDigits(middle, middleLength));
+    addInto(result + 2 * half, highLength, high, highLength);
+    free(low);
+    free(high);
+    free(aSum);
+    free(bSum);
+    free(middle);
+}
+
+// Divides the given number of digits in place by a single digit and returns
+// the remainder
+uint32_t divideBySmall(uint32_t *digits, int length, uint32_t divisor) {
+    uint64_t remainder = 0;
+    for(int i = length - 1; i >= 0; i--) {
+        uint64_t current = (remainder << 32) | digits[i];
+        digits[i] = (uint32_t)(current / divisor);
+        remainder = current % divisor;
+    }
+    return (uint32_t)remainder;
+}
+
+// Shifts the given digits left by the given number of bits, less than 32,
+// into result, which must have one more digit
+void shiftLeft(uint32_t *result, uint32_t *digits, int length, int shift) {
+    uint32_t carry = 0;
+    for(int i = 0; i < length; i++) {
+        result[i] = shift ? (digits[i] << shift) | carry : digits[i];
+        carry = shift ? digits[i] >> (32 - shift) : 0;
+    }
+    result[length] = carry;
+}
+
+// Divides the trimmed magnitude a by the trimmed magnitude b, which must not
+// be longer, storing aLength - bLength + 1 digits of quotient and bLength
+// digits of remainder. This is Knuth's algorithm D: each quotient digit is
+// estimated from the top digits and corrected at most twice.
+void divideDigits(uint32_t *quotient, uint32_t *remainder, uint32_t *a, int aLength,
+    uint32_t *b, int bLength) {
+    assert(bLength > 0 && aLength >= bLength);
+    if(bLength == 1) {
+        memcpy(quotient, a, aLength * sizeof(uint32_t));
+        remainder[0] = divideBySmall(quotient, aLength, b[0]);
+        return;
+    }
+
+    // shift both so that the top digit of the divisor has its high bit set
+    int shift = __builtin_clz(b[bLength - 1]);
+    uint32_t *u = newDigits(aLength + 1);
+    uint32_t *v = newDigits(bLength + 1);
+    shiftLeft(u, a, aLength, shift);
+    shiftLeft(v, b, bLength, shift);
+
+    uint64_t top = v[bLength - 1];
+    for(int j = aLength - bLength; j >= 0; j--) {
+        uint64_t numerator = ((uint64_t)u[j + bLength] << 32) | u[j + bLength - 1];
+        uint64_t guess = numerator / top;
+        uint64_t rest = numerator % top;
+        while(guess >> 32 ||
+            guess * v[bLength - 2] > ((rest << 32) | u[j + bLength - 2])) {
+            guess--;
+            rest += top;
+            if(rest >> 32) break;
+        }
+
+        uint64_t carry = 0;
+        uint64_t borrow = 0;
+        for(int i = 0; i < bLength; i++) {
+            uint64_t product = guess * v[i] + carry;
+            carry = product >> 32;
+            uint64_t difference = (uint64_t)u[i + j] - (uint32_t)product - borrow;
+            u[i + j] = (uint32_t)difference;
+            borrow = difference >> 63;
+        }
+        uint64_t difference = (uint64_t)u[j + bLength] - carry - borrow;
+        u[j + bLength] = (uint32_t)difference;
+
+        // the guess was one too big, so add the divisor back
+        if(difference >> 63) {
+            guess--;
+            carry = 0;
+            for(int i = 0; i < bLength; i++) {
+                carry += (uint64_t)u[i + j] + v[i];
+                u[i + j] = (uint32_t)carry;
+                carry >>= 32;
+            }
+            u[j + bLength] += (uint32_t)carry;
+        }
+        quotient[j] = (uint32_t)guess;
+    }
+
+    for(int i = 0; i < bLength; i++) {
+        remainder[i] = shift ? (u[i] >> shift) | (u[i + 1] << (32 - shift)) : u[i];
+    }
+    free(u);
+    free(v);
+}
+
+// Returns a + b, or a - b if subtract is set, for the integers a and b
+Value *addIntegers(Value *a, Value *b, bool subtract) {
+    Integer x, y;
+    viewInteger(a, &x);
+    viewInteger(b, &y);
+    if(subtract) y.sign = -y.sign;
+    int length = (x.length > y.length ? x.length : y.length) + 1;
+    uint32_t *digits = newDigits(length);
+    int sign = x.sign;
+    if(x.sign == y.sign) {
+        length = addDigits(digits, x.digits, x.length, y.digits, y.length);
+    } else if(compareDigits(x.digits, x.length, y.digits, y.length) >= 0) {
+        length = subtractDigits(digits, x.digits, x.length, y.digits, y.length);
+    } else {
+        sign = y.sign;
+        length = subtractDigits(digits, y.digits, y.length, x.digits, x.length);
+    }
+    return finishInteger(sign, digits, length);
+}
+
+// Returns a * b for the integers a and b
+Value *multiplyIntegers(Value *a, Value *b) {
+    Integer x, y;
+    viewInteger(a, &x);
+    viewInteger(b, &y);
+    int length = x.length + y.length;
+    uint32_t *digits = newDigits(length);
+    multiplyDigits(digits, x.digits, x.length, y.digits, y.length);
+    return finishInteger(x.sign * y.sign, digits, length);
+}
+
+// Divides the integer a by the nonzero integer b, rounding toward zero, and
+// stores the quotient and the remainder in the given places
+void divideIntegers(Value *a, Value *b, Value **quotient, Value **remainder) {
+    Integer x, y;
+    viewInteger(a, &x);
+    viewInteger(b, &y);
+    assert(y.length > 0);
+    if(compareDigits(x.digits, x.length, y.digits, y.length) < 0) {
+        *quotient = makeFixnum(0);
+        *remainder = a;
+        return;
+    }
+    uint32_t *q = newDigits(x.length - y.length + 1);
+    uint32_t *r = newDigits(y.length);
+    divideDigits(q, r, x.digits, x.length, y.digits, y.length);
+    *quotient = finishInteger(x.sign * y.sign, q, x.length - y.length + 1);
+    *remainder = finishInteger(x.sign, r, y.length);
+}
+
+// Returns the integer written in decimal in the given number of digits
+Value *parseInteger(char *digits, size_t count, bool negative) {
+    assert(digits);
+    int length = count / DECIMAL_PLACES + 2;
+    uint32_t *result = newDigits(length);
+    int used = 0;
+    size_t i = 0;
+    while(i < count) {
+        // multiply by 10^k and add the next k digits
+        uint32_t chunk = 0;
+        uint32_t scale = 1;
+        for(int k = 0; k < DECIMAL_PLACES && i < count; k++, i++) {
+            assert(digits[i] >= '0' && digits[i] <= '9');
+            chunk = chunk * 10 + (digits[i] - '0');
+            scale *= 10;
+        }
+        uint64_t carry = chunk;
+        for(int j = 0; j < used; j++) {
+            carry += (uint64_t)result[j] * scale;
+            result[j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if(carry) result[used++] = (uint32_t)carry;
+    }
+    return finishInteger(negative ? -1 : 1, result, length);
+}
+
+// Returns whether the given value is an integer or a double
+bool isNumeric(Value *value) {
+    valueType type = typeOf(value);
+    return type == INT_TYPE || type == BIGNUM_TYPE || type == DOUBLE_TYPE;
+}
+
+// Returns whether the given value is an integer
+bool isExact(Value *value) {
+    valueType type = typeOf(value);
+    return type == INT_TYPE || type == BIGNUM_TYPE;
+}
+
+// Returns the given number as a double
+double toDouble(Value *value) {
+    if(isFixnum(value)) return fixnumValue(value);
+    if(value->type == DOUBLE_TYPE) return value->d;
+    assert(value->type == BIGNUM_TYPE);
+    double result = 0;
+    for(int i = value->big.length - 1; i >= 0; i--) {
+        result = result * 4294967296.0 + value->big.digits[i];
+    }
+    return value->big.sign * result;
+}
+
+// Returns the sum of the given numbers
+Value *numberAdd(Value *a, Value *b) {
+    if(isFixnum(a) && isFixnum(b)) {
+        return makeInteger(fixnumValue(a) + fixnumValue(b));
+    }
+    if(isExact(a) && isExact(b)) return addIntegers(a, b, false);
+    return makeDouble(toDouble(a) + toDouble(b));
+}
+
+// Returns the difference of the given numbers
+Value *numberSubtract(Value *a, Value *b) {
+    if(isFixnum(a) && isFixnum(b)) {
+        return makeInteger(fixnumValue(a) - fixnumValue(b));
+    }
+    if(isExact(a) && isExact(b)) return addIntegers(a, b, true);
+    return makeDouble(toDouble(a) - toDouble(b));
+}
+
+// Returns the product of the given numbers
+Value *numberMultiply(Value *a, Value *b) {
+    if(isFixnum(a) && isFixnum(b)) {
+        intptr_t product;
+        if(!__builtin_mul_overflow(fixnumValue(a), fixnumValue(b), &product)) {
+            return makeInteger(product);
+        }
+    }
+    if(isExact(a) && isExact(b)) return multiplyIntegers(a, b);
+    return makeDouble(toDouble(a) * toDouble(b));
+}
+
+// Returns the quotient of the given numbers
+Value *numberDivide(Value *a, Value *b) {
+    if(isFixnum(a) && isFixnum(b)) {
+        intptr_t x = fixnumValue(a);
+        intptr_t y = fixnumValue(b);
+        assert(y != 0);
+        if(x % y == 0) return makeInteger(x / y);
+    } else if(isExact(a) && isExact(b)) {
+        Value *quotient;
+        Value *remainder;
+        divideIntegers(a, b, &quotient, &remainder);
+        if(numberIsZero(remainder)) return quotient;
+    }
+    return makeDouble(toDouble(a) / toDouble(b));
+}
+
+// Returns the remainder of dividing the given integers
+Value *numberRemainder(Value *a, Value *b) {
+    if(isFixnum(a) && isFixnum(b)) {
+        assert(fixnumValue(b) != 0);
+        return makeFixnum(fixnumValue(a) % fixnumValue(b));
+    }
+    Value *quotient;
+    Value *remainder;
+    divideIntegers(a, b, &quotient, &remainder);
+    return remainder;
+}
+
+// Compares the given numbers
+int numberCompare(Value *a, Value *b) {
+    if(isFixnum(a) && isFixnum(b)) {
+        intptr_t x = fixnumValue(a);
+        intptr_t y = fixnumValue(b);
+        return (x > y) - (x < y);
+    }
+    if(isExact(a) && isExact(b)) {
+        Integer x, y;
+        viewInteger(a, &x);
+        viewInteger(b, &y);
+        if(x.length == 0 && y.length == 0) return 0;
+        if(x.length == 0) return -y.sign;
+        if(y.length == 0 || x.sign != y.sign) return x.sign;
+        return x.sign * compareDigits(x.digits, x.length, y.digits, y.length);
+    }
+    double x = toDouble(a);
+    double y = toDouble(b);
+    return (x > y) - (x < y);
+}
+
+// Returns whether the given number is zero. Bignums never are.
+bool numberIsZero(Value *value) {
+    if(isFixnum(value)) return fixnumValue(value) == 0;
+    if(value->type == DOUBLE_TYPE) return value->d == 0;
+    return false;
+}
+
+// Prints the given integer in decimal by dividing a copy of it by 10^9 until
+// nothing is left, printing the remainders from the last one found
+void displayInteger(Value *value) {
+    if(isFixnum(value)) {
+        outputInteger(fixnumValue(value));
+        return;
+    }
+    assert(value->type == BIGNUM_TYPE);
+    int length = value->big.length;
+    uint32_t *digits = newDigits(length);
+    memcpy(digits, value->big.digits, length * sizeof(uint32_t));
+    uint32_t *chunks = newDigits(length * 10 / 9 + 1);
+    int chunkCount = 0;
+    while(length > 0) {
+        chunks[chunkCount++] = divideBySmall(digits, length, DECIMAL_BASE);
+        length = trimDigits(digits, length);
+    }
+    if(value->big.sign < 0) outputChar('-');
+    outputUnsigned(chunks[chunkCount - 1], 1);
+    for(int i = chunkCount - 2; i >= 0; i--) outputUnsigned(chunks[i], 9);
+    free(digits);
+    free(chunks);
+}
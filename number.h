@@ -0,0 +1,58 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "value.h"
+
+#ifndef _NUMBER
+#define _NUMBER
+
+// Integers are exact. Those between FIXNUM_MIN and FIXNUM_MAX are immediate
+// fixnums and the rest are BIGNUM_TYPE Values: a sign of 1 or -1 and the
+// magnitude as base 2^32 digits, least significant first, with no leading
+// zero digits. Arithmetic on integers gives integers, and anything involving
+// a DOUBLE_TYPE gives a double.
+
+// Returns the integer with the given value
+Value *makeInteger(intptr_t n);
+
+// Returns the integer written in decimal in the given number of digits,
+// negated if negative is set
+Value *parseInteger(char *digits, size_t length, bool negative);
+
+// Returns whether the given value is an integer or a double
+bool isNumeric(Value *value);
+
+// Returns whether the given value is an integer
+bool isExact(Value *value);
+
+// Returns the given number as a double, rounding big integers
+double toDouble(Value *value);
+
+// Returns the sum of the given numbers
+Value *numberAdd(Value *a, Value *b);
+
+// Returns the difference of the given numbers
+Value *numberSubtract(Value *a, Value *b);
+
+// Returns the product of the given numbers
+Value *numberMultiply(Value *a, Value *b);
+
+// Returns the quotient of the given numbers, which is an integer if both are
+// integers and b divides a, and a double otherwise. b must not be zero.
+Value *numberDivide(Value *a, Value *b);
+
+// Returns the remainder of dividing the given integers, rounding the quotient
+// toward zero, so the result has the sign of a. b must not be zero.
+Value *numberRemainder(Value *a, Value *b);
+
+// Returns a negative number, zero or a positive number as a is less than,
+// equal to or greater than b
+int numberCompare(Value *a, Value *b);
+
+// Returns whether the given number is zero
+bool numberIsZero(Value *value);
+
+// Prints the given integer in decimal
+void displayInteger(Value *value);
+
+#endif
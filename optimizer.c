@@ -0,0 +1,556 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "symbol.h"
+#include "number.h"
+#include "scan.h"
+#include "source.h"
+#include "resolver.h"
+#include "optimizer.h"
+
+// The optimizer works on expressions as they were read, before the resolver
+// sees them, so whatever it leaves behind is resolved and compiled as usual.
+// It keeps the list of names bound by the enclosing lambdas, lets and
+// defines, erring on the side of too many, so that a local variable that
+// happens to share a primitive's name is never folded.
+
+bool dumpOptimized = false;
+
+// What the arguments of a foldable primitive must be for a call of it to be
+// sure not to cause an error, which must be left for when the call runs
+typedef enum {NUMBERS,DIVISION,INTEGER_DIVISION,ANYTHING,PAIR} foldRule;
+
+// A primitive whose calls can be worked out ahead of time, since it has no
+// side effects and its result can't be told apart from a copy. redefined is
+// set once a define or set! of its name has been seen. cons is left out,
+// since each call makes a new pair.
+typedef struct Foldable Foldable;
+struct Foldable {
+    char *name;
+    foldRule rule;
+    Value *symbol;
+    bool redefined;
+};
+
+Foldable foldables[] = {
+    {"+", NUMBERS, NULL, false}, {"-", NUMBERS, NULL, false},
+    {"*", NUMBERS, NULL, false}, {"/", DIVISION, NULL, false},
+    {"modulo", INTEGER_DIVISION, NULL, false}, {"<", NUMBERS, NULL, false},
+    {">", NUMBERS, NULL, false}, {"=", NUMBERS, NULL, false},
+    {"<=", NUMBERS, NULL, false}, {">=", NUMBERS, NULL, false},
+    {"zero?", NUMBERS, NULL, false}, {"null?", ANYTHING, NULL, false},
+    {"car", PAIR, NULL, false}, {"cdr", PAIR, NULL, false},
+};
+
+#define FOLDABLE_COUNT (sizeof(foldables) / sizeof(Foldable))
+#define MAX_FOLD_ARGS 8
+
+// Whether every define and set! in the program was seen before the program
+// started running, so that calls can be folded even in code that runs later
+bool wholeProgram = false;
+
+Value *optimizeExpr(Value *expr, Value *bound, bool deferred);
+
+// Returns the length of the given list, or -1 if it isn't a proper list
+int listLength(Value *list) {
+    int length = 0;
+    while(typeOf(list) == CONS_TYPE) {
+        length++;
+        list = cdr(list);
+    }
+    return isNull(list) ? length : -1;
+}
+
+// Makes a list of two values
+Value *list2(Value *first, Value *second) {
+    return cons(first, cons(second, makeNull()));
+}
+
+// Makes a list of three values
+Value *list3(Value *first, Value *second, Value *third) {
+    return cons(first, list2(second, third));
+}
+
+// Returns whether the given name is in the given list
+bool contains(Value *list, Value *name) {
+    while(typeOf(list) == CONS_TYPE) {
+        if(car(list) == name) return true;
+        list = cdr(list);
+    }
+    return false;
+}
+
+// Returns the number of times the given name is in the given list
+int occurrences(Value *list, Value *name) {
+    int count = 0;
+    for(; typeOf(list) == CONS_TYPE; list = cdr(list)) {
+        if(car(list) == name) count++;
+    }
+    return count;
+}
+
+// Returns the foldable primitive with the given name, or NULL
+Foldable *findFoldable(Value *name) {
+    for(size_t i = 0; i < FOLDABLE_COUNT; i++) {
+        if(foldables[i].symbol == name) return &foldables[i];
+    }
+    return NULL;
+}
+
+// Notes that the name with the given characters may be assigned
+void markName(char *name, size_t length) {
+    for(size_t i = 0; i < FOLDABLE_COUNT; i++) {
+        if(strlen(foldables[i].name) == length && !memcmp(foldables[i].name, name, length)) {
+            foldables[i].redefined = true;
+        }
+    }
+}
+
+// Notes the names that any define or set! in the given expression assigns,
+// looking everywhere, quoted data included
+void markAssigned(Value *expr) {
+    while(typeOf(expr) == CONS_TYPE) {
+        Value *first = car(expr);
+        if((first == defineSymbol || first == setSymbol) &&
+            typeOf(cdr(expr)) == CONS_TYPE && typeOf(car(cdr(expr))) == SYMBOL_TYPE) {
+            char *name = car(cdr(expr))->s;
+            markName(name, strlen(name));
+        }
+        markAssigned(first);
+        expr = cdr(expr);
+    }
+}
+
+// Notes the names after every "(define" and "(set!" in the given program
+// text. Comments and strings can only add names, which just folds less.
+void scanProgram(char *text, size_t length) {
+    char *keywords[] = {"define", "set!"};
+    char *end = text + length;
+    char *p = text;
+    while((p = memchr(p, '(', end - p)) != NULL) {
+        p++;
+        while(p < end && (charClass[(unsigned char)*p] & SPACE_CLASS)) p++;
+        for(int i = 0; i < 2; i++) {
+            size_t size = strlen(keywords[i]);
+            if(end - p <= (long)size || memcmp(p, keywords[i], size) != 0 ||
+                !(charClass[(unsigned char)p[size]] & SPACE_CLASS)) continue;
+            char *name = p + size;
+            while(name < end && (charClass[(unsigned char)*name] & SPACE_CLASS)) name++;
+            char *nameEnd = name;
+            while(nameEnd < end && !(charClass[(unsigned char)*nameEnd] & BLANK_CLASS)) nameEnd++;
+            markName(name, nameEnd - name);
+        }
+    }
+}
+
+// Returns whether the given expression defines or sets the given name
+// anywhere inside it
+bool assigns(Value *expr, Value *name) {
+    while(typeOf(expr) == CONS_TYPE) {
+        Value *first = car(expr);
+        if((first == defineSymbol || first == setSymbol) &&
+            typeOf(cdr(expr)) == CONS_TYPE && car(cdr(expr)) == name) return true;
+        if(assigns(first, name)) return true;
+        expr = cdr(expr);
+    }
+    return false;
+}
+
+// Adds the name of every define anywhere inside the given expression to the
+// given list of bound names and returns it
+Value *bindDefines(Value *expr, Value *bound) {
+    while(typeOf(expr) == CONS_TYPE) {
+        Value *first = car(expr);
+        if(first == defineSymbol && typeOf(cdr(expr)) == CONS_TYPE) {
+            bound = cons(car(cdr(expr)), bound);
+        }
+        bound = bindDefines(first, bound);
+        expr = cdr(expr);
+    }
+    return bound;
+}
+
+// Returns whether there's a define anywhere inside the given expression
+bool hasDefine(Value *expr) {
+    while(typeOf(expr) == CONS_TYPE) {
+        if(car(expr) == defineSymbol || hasDefine(car(expr))) return true;
+        expr = cdr(expr);
+    }
+    return false;
+}
+
+// Returns whether the given expression is a constant: a number, a boolean, a
+// string, the empty list, a vector or a quote expression
+bool isConstant(Value *expr) {
+    valueType type = typeOf(expr);
+    if(type == CONS_TYPE) return car(expr) == quoteSymbol && listLength(expr) == 2;
+    return type == INT_TYPE || type == BIGNUM_TYPE || type == DOUBLE_TYPE ||
+        type == BOOL_TYPE || type == STR_TYPE || type == NULL_TYPE ||
+        type == VECTOR_TYPE;
+}
+
+// Returns the value of the given constant
+Value *constantValue(Value *expr) {
+    assert(isConstant(expr));
+    return typeOf(expr) == CONS_TYPE ? car(cdr(expr)) : expr;
+}
+
+// Returns a constant expression for the given value, quoting it unless it
+// evaluates to itself
+Value *makeConstant(Value *value) {
+    valueType type = typeOf(value);
+    if(type == CONS_TYPE || type == SYMBOL_TYPE) return list2(quoteSymbol, value);
+    return value;
+}
+
+// Returns whether the given constant expression is #t, the only true value
+bool isTrue(Value *expr) {
+    return constantValue(expr) == makeBool(true);
+}
+
+// Returns whether the given bindings of a let, let* or letrec are a list of
+// names each paired with one expression
+bool wellFormedBindings(Value *bindings) {
+    if(listLength(bindings) < 0) return false;
+    for(Value *cur = bindings; !isNull(cur); cur = cdr(cur)) {
+        Value *binding = car(cur);
+        if(listLength(binding) != 2 || typeOf(car(binding)) != SYMBOL_TYPE) return false;
+    }
+    return true;
+}
+
+// Adds the names of the given well formed bindings to the given list of
+// bound names and returns it
+Value *bindNames(Value *bindings, Value *bound) {
+    for(Value *cur = bindings; !isNull(cur); cur = cdr(cur)) {
+        bound = cons(car(car(cur)), bound);
+    }
+    return bound;
+}
+
+// Optimizes each expression in the given list
+Value *optimizeEach(Value *list, Value *bound, bool deferred) {
+    Value *optimized = makeNull();
+    for(Value *cur = list; !isNull(cur); cur = cdr(cur)) {
+        optimized = cons(optimizeExpr(car(cur), bound, deferred), optimized);
+    }
+    return reverse(optimized);
+}
+
+// Returns a copy of the given expression with every reference to the given
+// variable replaced by the given constant, or sets blocked if that can't be
+// done without changing what the expression means. The variable is never
+// assigned in the expression.
+Value *substitute(Value *expr, Value *name, Value *constant, bool *blocked);
+
+// Substitutes the constant into each expression in the given list
+Value *substituteEach(Value *list, Value *name, Value *constant, bool *blocked) {
+    Value *result = makeNull();
+    for(Value *cur = list; !isNull(cur); cur = cdr(cur)) {
+        result = cons(substitute(car(cur), name, constant, blocked), result);
+    }
+    return reverse(result);
+}
+
+Value *substitute(Value *expr, Value *name, Value *constant, bool *blocked) {
+    if(expr == name) return constant;
+    if(typeOf(expr) != CONS_TYPE) return expr;
+    int length = listLength(expr);
+    Value *first = car(expr);
+    if(length < 0) {
+        *blocked = true;
+        return expr;
+    }
+    if(first == quoteSymbol) return expr;
+    if(first == lambdaSymbol) {
+        if(length != 3 || listLength(car(cdr(expr))) < 0) {
+            *blocked = true;
+            return expr;
+        }
+        if(contains(car(cdr(expr)), name)) return expr;
+        return list3(first, car(cdr(expr)), substitute(car(cdr(cdr(expr))), name, constant, blocked));
+    }
+    if(first == letSymbol || first == letStarSymbol || first == letRecSymbol) {
+        if(length != 3 || !wellFormedBindings(car(cdr(expr)))) {
+            *blocked = true;
+            return expr;
+        }
+        bool shadowed = contains(bindNames(car(cdr(expr)), makeNull()), name);
+        // a let* or letrec that binds the name sees it in only some inits
+        if(shadowed && first != letSymbol) {
+            *blocked = true;
+            return expr;
+        }
+        Value *bindings = makeNull();
+        for(Value *cur = car(cdr(expr)); !isNull(cur); cur = cdr(cur)) {
+            Value *init = substitute(car(cdr(car(cur))), name, constant, blocked);
+            bindings = cons(list2(car(car(cur)), init), bindings);
+        }
+        Value *body = car(cdr(cdr(expr)));
+        if(!shadowed) body = substitute(body, name, constant, blocked);
+        return list3(first, reverse(bindings), body);
+    }
+    if(first == condSymbol) {
+        Value *clauses = makeNull();
+        for(Value *cur = cdr(expr); !isNull(cur); cur = cdr(cur)) {
+            Value *clause = car(cur);
+            if(typeOf(clause) == CONS_TYPE && isNull(cdr(cur)) && car(clause) == elseSymbol) {
+                clause = cons(elseSymbol, substituteEach(cdr(clause), name, constant, blocked));
+            } else if(listLength(clause) >= 0) {
+                clause = substituteEach(clause, name, constant, blocked);
+            } else if(typeOf(clause) == CONS_TYPE) *blocked = true;
+            clauses = cons(clause, clauses);
+        }
+        return cons(first, reverse(clauses));
+    }
+    if(first == defineSymbol || first == setSymbol) {
+        if(length != 3) {
+            *blocked = true;
+            return expr;
+        }
+        return list3(first, car(cdr(expr)), substitute(car(cdr(cdr(expr))), name, constant, blocked));
+    }
+    if(first == ifSymbol || first == andSymbol || first == orSymbol || first == beginSymbol) {
+        return cons(first, substituteEach(cdr(expr), name, constant, blocked));
+    }
+    // a constant in place of the function would be a different error
+    if(first == name) {
+        *blocked = true;
+        return expr;
+    }
+    return substituteEach(expr, name, constant, blocked);
+}
+
+// Optimizes an if expression, keeping only the branch that runs when the
+// test is a constant
+Value *optimizeIf(Value *expr, Value *bound, bool deferred) {
+    if(listLength(expr) != 4) return expr;
+    Value *args = cdr(expr);
+    Value *test = optimizeExpr(car(args), bound, deferred);
+    if(isConstant(test)) {
+        Value *branch = isTrue(test) ? car(cdr(args)) : car(cdr(cdr(args)));
+        return optimizeExpr(branch, bound, deferred);
+    }
+    return cons(ifSymbol, cons(test, optimizeEach(cdr(args), bound, deferred)));
+}
+
+// Optimizes a cond expression. Clauses whose test is #f are dropped, and a
+// clause whose test is #t ends the cond as its else. Everything from a
+// malformed clause or a test that isn't a boolean on is kept as it is, so the
+// error still happens when it's reached.
+Value *optimizeCond(Value *expr, Value *bound, bool deferred) {
+    Value *kept = makeNull();
+    Value *cur = cdr(expr);
+    while(!isNull(cur)) {
+        Value *clause = car(cur);
+        bool last = isNull(cdr(cur));
+        if(listLength(clause) != 2) break;
+        Value *value = optimizeExpr(car(cdr(clause)), bound, deferred);
+        Value *test = car(clause);
+        if(last && test == elseSymbol) {
+            if(isNull(kept)) return value;
+            kept = cons(list2(elseSymbol, value), kept);
+            cur = cdr(cur);
+            break;
+        }
+        test = optimizeExpr(test, bound, deferred);
+        if(isConstant(test) && isTrue(test)) {
+            if(isNull(kept)) return value;
+            kept = cons(list2(elseSymbol, value), kept);
+            cur = makeNull();
+            break;
+        }
+        bool isFalse = isConstant(test) && constantValue(test) == makeBool(false);
+        // dropping the last clause makes the one before it last, where a test
+        // named else would turn into the keyword
+        if(isFalse && !(last && !isNull(kept) && car(car(kept)) == elseSymbol)) {
+            cur = cdr(cur);
+            continue;
+        }
+        kept = cons(list2(test, value), kept);
+        cur = cdr(cur);
+        if(isConstant(test) && !isFalse) break;
+    }
+    Value *clauses = cur;
+    for(Value *k = kept; !isNull(k); k = cdr(k)) clauses = cons(car(k), clauses);
+    return cons(condSymbol, clauses);
+}
+
+// Optimizes an and or an or expression, which is a constant when its first
+// argument decides it, or when both are constant booleans
+Value *optimizeLogic(Value *expr, Value *bound, bool deferred) {
+    if(listLength(expr) != 3) return expr;
+    Value *first = optimizeExpr(car(cdr(expr)), bound, deferred);
+    Value *second = optimizeExpr(car(cdr(cdr(expr))), bound, deferred);
+    bool isAnd = car(expr) == andSymbol;
+    if(isConstant(first) && typeOf(constantValue(first)) == BOOL_TYPE) {
+        bool value = isTrue(first);
+        if(value != isAnd) return makeBool(value);
+        if(isConstant(second) && typeOf(constantValue(second)) == BOOL_TYPE) {
+            return constantValue(second);
+        }
+    }
+    return list3(car(expr), first, second);
+}
+
+// Optimizes a let expression. Each binding to a constant that's never
+// assigned is substituted into the body and dropped, and a let left without
+// bindings or defines is replaced by its body.
+Value *optimizeLet(Value *expr, Value *bound, bool deferred) {
+    if(listLength(expr) != 3 || !wellFormedBindings(car(cdr(expr)))) return expr;
+    Value *body = car(cdr(cdr(expr)));
+    Value *names = bindNames(car(cdr(expr)), makeNull());
+    Value *kept = makeNull();
+    for(Value *cur = car(cdr(expr)); !isNull(cur); cur = cdr(cur)) {
+        Value *name = car(car(cur));
+        Value *init = optimizeExpr(car(cdr(car(cur))), bound, deferred);
+        if(isConstant(init) && name != elseSymbol && !assigns(body, name) &&
+            occurrences(names, name) == 1) {
+            bool blocked = false;
+            Value *substituted = substitute(body, name, init, &blocked);
+            if(!blocked) {
+                body = substituted;
+                continue;
+            }
+        }
+        kept = cons(list2(name, init), kept);
+    }
+    kept = reverse(kept);
+    if(isNull(kept) && !hasDefine(body)) return optimizeExpr(body, bound, deferred);
+    Value *inner = bindDefines(body, bindNames(kept, bound));
+    return list3(letSymbol, kept, optimizeExpr(body, inner, deferred));
+}
+
+// Optimizes a let* or letrec expression. Every name it binds is taken to be
+// bound throughout.
+Value *optimizeLetStar(Value *expr, Value *bound, bool deferred) {
+    if(listLength(expr) != 3 || !wellFormedBindings(car(cdr(expr)))) return expr;
+    Value *inner = bindDefines(expr, bindNames(car(cdr(expr)), bound));
+    Value *bindings = makeNull();
+    for(Value *cur = car(cdr(expr)); !isNull(cur); cur = cdr(cur)) {
+        Value *init = optimizeExpr(car(cdr(car(cur))), inner, deferred);
+        bindings = cons(list2(car(car(cur)), init), bindings);
+    }
+    Value *body = optimizeExpr(car(cdr(cdr(expr))), inner, deferred);
+    return list3(car(expr), reverse(bindings), body);
+}
+
+// Optimizes a lambda expression, whose body runs later, so is always
+// optimized as deferred
+Value *optimizeLambda(Value *expr, Value *bound) {
+    if(listLength(expr) != 3) return expr;
+    Value *params = car(cdr(expr));
+    if(listLength(params) < 0) return expr;
+    Value *inner = bound;
+    for(Value *cur = params; !isNull(cur); cur = cdr(cur)) inner = cons(car(cur), inner);
+    inner = bindDefines(car(cdr(cdr(expr))), inner);
+    return list3(lambdaSymbol, params, optimizeExpr(car(cdr(cdr(expr))), inner, true));
+}
+
+// Optimizes a begin expression, dropping constants whose values are thrown
+// away
+Value *optimizeBegin(Value *expr, Value *bound, bool deferred) {
+    if(isNull(cdr(expr))) return expr;
+    Value *kept = makeNull();
+    for(Value *cur = cdr(expr); !isNull(cur); cur = cdr(cur)) {
+        Value *optimized = optimizeExpr(car(cur), bound, deferred);
+        if(isNull(cdr(cur)) || !isConstant(optimized)) kept = cons(optimized, kept);
+    }
+    if(isNull(cdr(kept))) return car(kept);
+    return cons(beginSymbol, reverse(kept));
+}
+
+// Returns whether calling the given foldable primitive on the given
+// arguments is sure not to cause an error
+bool canFold(Foldable *foldable, Value *primitive, int argc, Value **argv) {
+    if(argc < primitive->prim.minArgs ||
+        (primitive->prim.maxArgs >= 0 && argc > primitive->prim.maxArgs)) return false;
+    switch(foldable->rule) {
+    case NUMBERS:
+        for(int i = 0; i < argc; i++) {
+            if(!isNumeric(argv[i])) return false;
+        }
+        return true;
+    case DIVISION:
+        return isNumeric(argv[0]) && isNumeric(argv[1]) && !numberIsZero(argv[1]);
+    case INTEGER_DIVISION:
+        return isExact(argv[0]) && isExact(argv[1]) && !numberIsZero(argv[1]);
+    case PAIR:
+        return typeOf(argv[0]) == CONS_TYPE;
+    default:
+        return true;
+    }
+}
+
+// Optimizes a function call, working it out now if it's a call of a foldable
+// primitive on constants. The name must be global and never redefined, and
+// unless the whole program has been checked for that, the call must be
+// about to run.
+Value *optimizeCall(Value *expr, Value *bound, bool deferred) {
+    Value *call = optimizeEach(expr, bound, deferred);
+    Value *name = car(call);
+    if(typeOf(name) != SYMBOL_TYPE || contains(bound, name)) return call;
+    if(deferred && !wholeProgram) return call;
+    Foldable *foldable = findFoldable(name);
+    if(foldable == NULL || foldable->redefined) return call;
+    Value *primitive = globalCell(name)->b.val;
+    if(primitive == NULL || typeOf(primitive) != PRIMITIVE_TYPE) return call;
+
+    Value *argv[MAX_FOLD_ARGS];
+    int argc = 0;
+    for(Value *cur = cdr(call); !isNull(cur); cur = cdr(cur)) {
+        if(argc == MAX_FOLD_ARGS || !isConstant(car(cur))) return call;
+        argv[argc++] = constantValue(car(cur));
+    }
+    if(!canFold(foldable, primitive, argc, argv)) return call;
+    return makeConstant(primitive->prim.function(argc, argv));
+}
+
+// Optimizes the given expression. bound lists the names that may be local
+// variables where it is, and deferred is set inside lambdas, whose bodies
+// run after later expressions have been read.
+Value *optimizeExpr(Value *expr, Value *bound, bool deferred) {
+    assert(expr);
+    if(typeOf(expr) != CONS_TYPE || listLength(expr) < 0) return expr;
+    Value *first = car(expr);
+    if(first == quoteSymbol) return expr;
+    if(first == ifSymbol) return optimizeIf(expr, bound, deferred);
+    if(first == condSymbol) return optimizeCond(expr, bound, deferred);
+    if(first == andSymbol || first == orSymbol) return optimizeLogic(expr, bound, deferred);
+    if(first == letSymbol) return optimizeLet(expr, bound, deferred);
+    if(first == letStarSymbol || first == letRecSymbol) {
+        return optimizeLetStar(expr, bound, deferred);
+    }
+    if(first == lambdaSymbol) return optimizeLambda(expr, bound);
+    if(first == beginSymbol) return optimizeBegin(expr, bound, deferred);
+    if(first == defineSymbol || first == setSymbol) {
+        if(listLength(expr) != 3) return expr;
+        Value *value = optimizeExpr(car(cdr(cdr(expr))), bound, deferred);
+        return list3(first, car(cdr(expr)), value);
+    }
+    return optimizeCall(expr, bound, deferred);
+}
+
+// Finds the foldable primitives' names, and scans the whole program for
+// assignments if it's in memory
+void initOptimizer(Source *source) {
+    assert(source);
+    for(size_t i = 0; i < FOLDABLE_COUNT; i++) {
+        foldables[i].symbol = intern(foldables[i].name);
+        foldables[i].redefined = false;
+    }
+    wholeProgram = source->mapped;
+    if(wholeProgram) scanProgram(source->data, source->length);
+}
+
+// Optimizes a top level expression
+Value *optimize(Value *expr) {
+    assert(expr);
+    markAssigned(expr);
+    return optimizeExpr(expr, makeNull(), false);
+}
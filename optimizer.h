@@ -0,0 +1,25 @@
+#include <stdbool.h>
+#include "value.h"
+#include "source.h"
+
+#ifndef _OPTIMIZER
+#define _OPTIMIZER
+
+// Whether each top level expression is printed after it has been optimized,
+// before its result
+extern bool dumpOptimized;
+
+// Prepares to optimize the expressions of the given source. When the whole
+// program is already in memory, it is scanned for every name that a define or
+// set! could change, so calls of primitives that are never redefined can be
+// folded anywhere. Otherwise only code that runs as soon as it's read has its
+// calls folded. Must be called after the primitives are bound.
+void initOptimizer(Source *source);
+
+// Returns the given top level expression, as read, with calls of pure
+// primitives on constants worked out, the branches of if, cond, and and or
+// that can't run removed, and variables that let binds to constants replaced
+// by them. The result means the same, errors included.
+Value *optimize(Value *expr);
+
+#endif
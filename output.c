@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "output.h"
+
+// Characters waiting to be written to stdout
+char outputBuffer[OUTPUT_BUFFER_SIZE];
+size_t outputLength = 0;
+
+// The decimal digits of every number from 00 to 99, for printing numbers two
+// digits at a time
+const char digitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Writes everything in the output buffer to stdout and empties it
+void flushOutput() {
+    if(outputLength > 0) fwrite(outputBuffer, 1, outputLength, stdout);
+    outputLength = 0;
+}
+
+// Adds the given characters to the output buffer. Runs too big for the buffer
+// go straight to stdout after what's already in it.
+void outputChars(const char *chars, size_t length) {
+    if(outputLength + length > OUTPUT_BUFFER_SIZE) {
+        flushOutput();
+        if(length > OUTPUT_BUFFER_SIZE) {
+            fwrite(chars, 1, length, stdout);
+            return;
+        }
+    }
+    memcpy(outputBuffer + outputLength, chars, length);
+    outputLength += length;
+}
+
+// Adds the given character to the output buffer
+void outputChar(char c) {
+    if(outputLength == OUTPUT_BUFFER_SIZE) flushOutput();
+    outputBuffer[outputLength++] = c;
+}
+
+// Adds the given null terminated string to the output buffer
+void outputString(const char *s) {
+    outputChars(s, strlen(s));
+}
+
+// Adds the given number to the output buffer in decimal, zero padded to at
+// least width digits. The digits are made from the right, two at a time.
+void outputUnsigned(uint64_t n, int width) {
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *start = end;
+    while(n >= 100) {
+        start -= 2;
+        memcpy(start, digitPairs + 2 * (n % 100), 2);
+        n /= 100;
+    }
+    if(n >= 10) {
+        start -= 2;
+        memcpy(start, digitPairs + 2 * n, 2);
+    } else *--start = '0' + n;
+    while(end - start < width && start > digits) *--start = '0';
+    outputChars(start, end - start);
+}
+
+// Adds the given number to the output buffer in decimal
+void outputInteger(long long n) {
+    if(n < 0) {
+        outputChar('-');
+        outputUnsigned(-(uint64_t)n, 1);
+    } else outputUnsigned(n, 1);
+}
+
+// Adds the given number to the output buffer with six digits after the point
+void outputDouble(double d) {
+    char text[400];
+    int length = snprintf(text, sizeof(text), "%f", d);
+    outputChars(text, length);
+}
+
+// Adds the given pointer to the output buffer
+void outputPointer(void *p) {
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%p", p);
+    outputChars(text, length);
+}
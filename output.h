@@ -0,0 +1,40 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _OUTPUT
+#define _OUTPUT
+
+// The number of characters of output kept before they're written out
+#ifndef OUTPUT_BUFFER_SIZE
+#define OUTPUT_BUFFER_SIZE 65536
+#endif
+
+// Adds the given number of characters to the output buffer, writing the
+// buffer to stdout whenever it fills up
+void outputChars(const char *chars, size_t length);
+
+// Adds the given character to the output buffer
+void outputChar(char c);
+
+// Adds the given null terminated string to the output buffer
+void outputString(const char *s);
+
+// Adds the given number in decimal to the output buffer, with at least width
+// digits, padded with zeros
+void outputUnsigned(uint64_t n, int width);
+
+// Adds the given number in decimal to the output buffer, the same way printf's
+// %lld would
+void outputInteger(long long n);
+
+// Adds the given number to the output buffer the same way printf's %f would
+void outputDouble(double d);
+
+// Adds the given pointer to the output buffer the same way printf's %p would
+void outputPointer(void *p);
+
+// Hands everything in the output buffer to stdout. This must be done before
+// anything else is printed to stdout, so that the output stays in order.
+void flushOutput();
+
+#endif
@@ -1,104 +1,72 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <assert.h>
-#include "value.h"
-#include "linkedlist.h"
-#include "talloc.h"
-
-struct Stack {
-    Value *top;
-};
-typedef struct Stack Stack;
-
-// Helper function to initialize a stack
-void initStack(Stack *stack) {
-    assert(stack);
-    stack->top = (Value *)talloc(sizeof(Value));
-    stack->top->type = NULL_TYPE;
-}
-
-// Push the given item onto the given stack
-void push(Stack *stack, Value *item) {
-    assert(stack);
-    assert(item);
-    Value *consValue = (Value *)talloc(sizeof(Value));
-    consValue->type = CONS_TYPE;
-    setCar(consValue, item);
-    setCdr(consValue, stack->top);
-    stack->top = consValue;
-}
-
-// Pop the next value off of the given stack
-Value *pop(Stack *stack) {
-    assert(stack);
-    Value *popped = car(stack->top);
-    stack->top = cdr(stack->top);
-    return popped;
-}
-
-// Returns whether or not the given stack is empty
-bool isEmpty(Stack *stack) {
-    assert(stack);
-    return isNull(stack->top);
-}
-
-// Takes a list of tokens from a Racket program, and returns a pointer to a
-// parse tree representing that program.
-Value *parse(Value *tokens) {
-    assert(tokens);
-    assert(tokens->type == CONS_TYPE);
-    Stack *stack = (Stack *)talloc(sizeof(Stack));
-    initStack(stack);
-    Value *curToken = tokens;
-    int depth = 0;
-    while(!isNull(curToken)) {
-        // increase depth when there's an open paren
-        if(car(curToken)->type == OPEN_TYPE) depth++;
-        // close paren, so a rule has been completed
-        if(car(curToken)->type == CLOSE_TYPE) {
-            Value *cur = pop(stack);
-            Value *list = makeNull();
-            // pop everything from stack until next open paren
-            // make list of popped items and push that onto the stack
-            while(cur->type != OPEN_TYPE) {
-                // if the stack is empty before another paren, throw error
-                if(isEmpty(stack)) {
-                    printf("Syntax error: too many close parentheses\n");
-                    texit(2);
-                }
-                list = cons(cur, list);
-                cur = pop(stack);
-            }
-            push(stack, list);
-            depth--;
-        }
-        // otherwise, push item onto stack
-        else {
-            push(stack, car(curToken));
-        }
-        // move on to next token
-        curToken = cdr(curToken);
-    }
-    // if depth is not zero, then there's a paren mismatch
-    if(depth != 0) {
-        printf("Syntax error: not enough close parentheses\n");
-        texit(1);
-    }
-    // reverse the stack and return it
-    Stack *final = (Stack *)talloc(sizeof(Stack));
-    initStack(final);
-    while(!isEmpty(stack)) push(final, pop(stack));
-    return final->top;
-}
-
-// Prints the tree to the screen in a readable fashion,
-// uses parentheses to indicate subtrees.
-void printTree(Value *tree) {
-    assert(tree);
-    assert(tree->type == CONS_TYPE);
-    Value *cur = tree;
-    while(!isNull(cur)) {
-        display(car(cur));
-        cur = cdr(cur);
-    }
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "source.h"
+#include "tokenizer.h"
+#include "output.h"
+
+// Reads one top level expression from the given source and returns its parse
+// tree, or NULL at the end of the input. Each list is built in place as its
+// elements are read, so the only allocation per token is the cons cell that
+// holds it in the tree. levels has a pair for every paren that is still open,
+// innermost first, holding the first and last cells of its list so far.
+// vectors holds the cells of levels that were opened by #(, whose lists
+// become vectors when they're closed.
+Value *readDatum(Source *source) {
+    assert(source);
+    Value *levels = makeNull();
+    Value *vectors = makeNull();
+    Value *token;
+    Value *datum;
+    while((token = readToken(source)) != NULL) {
+        if(typeOf(token) == OPEN_TYPE || typeOf(token) == OPEN_VECTOR_TYPE) {
+            levels = cons(cons(makeNull(), makeNull()), levels);
+            if(typeOf(token) == OPEN_VECTOR_TYPE) vectors = cons(levels, vectors);
+            continue;
+        }
+        // close paren, so the innermost list is complete
+        if(typeOf(token) == CLOSE_TYPE) {
+            if(isNull(levels)) {
+                printf("Syntax error: too many close parentheses\n");
+                texit(2);
+            }
+            datum = car(car(levels));
+            if(!isNull(vectors) && car(vectors) == levels) {
+                datum = listToVector(datum);
+                vectors = cdr(vectors);
+            }
+            levels = cdr(levels);
+        }
+        else datum = token;
+        // the expression is complete once every paren has been closed
+        if(isNull(levels)) return datum;
+
+        // otherwise, append it to the innermost list
+        Value *level = car(levels);
+        Value *cell = cons(datum, makeNull());
+        if(isNull(car(level))) setCar(level, cell);
+        else setCdr(cdr(level), cell);
+        setCdr(level, cell);
+    }
+    if(!isNull(levels)) {
+        printf("Syntax error: not enough close parentheses\n");
+        texit(1);
+    }
+    return NULL;
+}
+
+// Prints the tree to the screen in a readable fashion,
+// uses parentheses to indicate subtrees.
+void printTree(Value *tree) {
+    assert(tree);
+    assert(typeOf(tree) == CONS_TYPE);
+    Value *cur = tree;
+    while(!isNull(cur)) {
+        display(car(cur));
+        cur = cdr(cur);
+    }
+    flushOutput();
+}
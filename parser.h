@@ -1,11 +1,13 @@
 #include "value.h"
+#include "source.h"
 
 #ifndef _PARSER
 #define _PARSER
 
-// Takes a list of tokens from a Racket program, and returns a pointer to a
-// parse tree representing that program.
-Value *parse(Value *tokens);
+// Reads the tokens of one top level expression from the given source and
+// returns its parse tree, or NULL at the end of the input. Nothing past the
+// end of the expression is read.
+Value *readDatum(Source *source);
 
 
 // Prints the tree to the screen in a readable fashion. It should look just like
@@ -0,0 +1,643 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "gc.h"
+#include "symbol.h"
+#include "number.h"
+#include "resolver.h"
+
+Value *ifSymbol, *condSymbol, *andSymbol, *orSymbol, *letSymbol;
+Value *letStarSymbol, *letRecSymbol, *quoteSymbol, *defineSymbol;
+Value *setSymbol, *lambdaSymbol, *beginSymbol, *elseSymbol;
+Value *boxSymbol;
+
+// Open addressing hash table of global cells, keyed by symbol
+Value **globals = NULL;
+size_t globalCapacity = 0;
+size_t globalCount = 0;
+
+// What is known about a variable once every reference to it is resolved: a
+// lambda captures it, it's stored into after its frame is made, or it's
+// stored into when closures may already have captured it
+#define CAPTURED 1
+#define MUTATED 2
+#define LATE 4
+
+// A variable of an enclosing scope that a lambda captures, and its address
+// as seen from the scope the lambda is in
+typedef struct Capture Capture;
+struct Capture {
+    struct Scope *home;
+    int slot;
+    Value *address;
+};
+
+// The names of the variables in one frame, in slot order. While a let* is
+// being resolved the bindings in [hidden, bindings) aren't in scope yet. The
+// first assigned slots are filled in when the frame is made, so reading them
+// never finds them unassigned. Each slot has the list of addresses that refer
+// to it, from this scope or nested ones, and its CAPTURED, MUTATED and LATE
+// flags. A closure that captures a slot from ready up may run before the
+// slot is stored. The scope of a lambda body also lists the variables it
+// captures. Scopes that are being resolved are linked through open, so that
+// the addresses they hold are roots.
+typedef struct Scope Scope;
+struct Scope {
+    Scope *parent;
+    Scope *open;
+    Value **names;
+    Value **uses;
+    char *flags;
+    int count;
+    int capacity;
+    int hidden;
+    int bindings;
+    int assigned;
+    int ready;
+    bool function;
+    Capture *captures;
+    int captureCount;
+    int captureCapacity;
+};
+
+// The innermost scope that is being resolved
+Scope *openScopes = NULL;
+
+Value *resolveExpr(Value *expr, Scope *scope);
+
+// Returns the slot of the global table that holds the cell for the given
+// symbol, or the empty slot where it should go
+size_t globalSlot(Value *symbol) {
+    size_t mask = globalCapacity - 1;
+    size_t i = ((uintptr_t)symbol >> 4) * 11400714819323198485ull >> 32 & mask;
+    while(globals[i] != NULL && var(globals[i]) != symbol) i = (i + 1) & mask;
+    return i;
+}
+
+// Visits every global cell for the garbage collector
+void visitGlobals() {
+    for(size_t i = 0; i < globalCapacity; i++) {
+        if(globals[i] != NULL) gcVisit((void **)&globals[i]);
+    }
+}
+
+// Visits the uses and captures of every scope that is being resolved
+void visitScopes() {
+    for(Scope *scope = openScopes; scope != NULL; scope = scope->open) {
+        for(int i = 0; i < scope->count; i++) gcVisit((void **)&scope->uses[i]);
+        for(int i = 0; i < scope->captureCount; i++) {
+            gcVisit((void **)&scope->captures[i].address);
+        }
+    }
+}
+
+// Doubles the size of the global table and reinserts every cell
+void growGlobals() {
+    Value **old = globals;
+    size_t oldCapacity = globalCapacity;
+    globalCapacity = globalCapacity ? globalCapacity * 2 : 64;
+    globals = (Value **)talloc(globalCapacity * sizeof(Value *));
+    memset(globals, 0, globalCapacity * sizeof(Value *));
+    for(size_t i = 0; i < oldCapacity; i++) {
+        if(old[i] != NULL) globals[globalSlot(var(old[i]))] = old[i];
+    }
+}
+
+// Returns the cell of the global variable with the given name, creating an
+// undefined one the first time the name is seen
+Value *globalCell(Value *symbol) {
+    assert(symbol);
+    assert(typeOf(symbol) == SYMBOL_TYPE);
+    if((globalCount + 1) * 2 > globalCapacity) growGlobals();
+    size_t slot = globalSlot(symbol);
+    if(globals[slot] != NULL) return globals[slot];
+
+    Value *cell = (Value *)gcAllocOld(sizeof(Value), VALUE_OBJECT);
+    cell->type = BINDING_TYPE;
+    cell->b.var = symbol;
+    cell->b.val = NULL;
+    globals[slot] = cell;
+    globalCount++;
+    return cell;
+}
+
+// Interns the special form names and sets up the global table
+void initResolver() {
+    ifSymbol = intern("if");
+    condSymbol = intern("cond");
+    andSymbol = intern("and");
+    orSymbol = intern("or");
+    letSymbol = intern("let");
+    letStarSymbol = intern("let*");
+    letRecSymbol = intern("letrec");
+    quoteSymbol = intern("quote");
+    defineSymbol = intern("define");
+    setSymbol = intern("set!");
+    lambdaSymbol = intern("lambda");
+    beginSymbol = intern("begin");
+    elseSymbol = intern("else");
+    boxSymbol = intern("box");
+    if(globals == NULL) {
+        growGlobals();
+        gcAddRoots(visitGlobals);
+        gcAddRoots(visitScopes);
+    }
+}
+
+// Creates an ERROR_TYPE Value that causes the given evaluation error
+Value *makeError(int errorCode) {
+    Value *error = gcAllocValue();
+    error->type = ERROR_TYPE;
+    error->i = errorCode;
+    return error;
+}
+
+// Creates a LOCAL_TYPE Value referring to the given slot of the frame the
+// given number of levels up, noting whether the slot is always assigned, and
+// links it into the uses of the variable in the given slot of the given scope
+Value *makeAddress(int depth, int index, bool assigned, Scope *home, int slot) {
+    Value *address = gcAllocValue();
+    address->type = LOCAL_TYPE;
+    address->a.depth = depth;
+    address->a.index = index;
+    address->a.assigned = assigned;
+    address->a.boxed = false;
+    address->a.next = home->uses[slot];
+    home->uses[slot] = address;
+    return address;
+}
+
+// Creates a BODY_TYPE Value for an expression that runs in a new frame. Now
+// that every reference to the frame's variables has been resolved, the ones
+// that a closure captures but that may change after it does are put in
+// boxes: cells that the frame and the closures share. The expression is
+// then wrapped in (box (slot ...) expr) to say which slots to box when the
+// frame is made. The addresses are unlinked from each other as they're
+// visited, so the resolved expression doesn't hold on to them.
+Value *makeBody(Value *expr, Scope *scope) {
+    assert(expr);
+    Value *boxed = makeNull();
+    for(int i = scope->count - 1; i >= 0; i--) {
+        bool box = (scope->flags[i] & CAPTURED) && (scope->flags[i] & (MUTATED | LATE));
+        Value *use = scope->uses[i];
+        while(use != NULL) {
+            Value *next = use->a.next;
+            use->a.boxed = box;
+            use->a.next = NULL;
+            use = next;
+        }
+        scope->uses[i] = NULL;
+        if(box) boxed = cons(makeInteger(i), boxed);
+    }
+    if(!isNull(boxed)) expr = cons(boxSymbol, cons(boxed, cons(expr, makeNull())));
+    Value *body = gcAllocValue();
+    body->type = BODY_TYPE;
+    body->body.frameSize = scope->count;
+    body->body.expr = expr;
+    return body;
+}
+
+// Initializes the given scope with no variables and opens it
+void initScope(Scope *scope, Scope *parent) {
+    assert(scope);
+    scope->parent = parent;
+    scope->open = openScopes;
+    openScopes = scope;
+    scope->capacity = 8;
+    scope->count = 0;
+    scope->hidden = 0;
+    scope->bindings = 0;
+    scope->assigned = 0;
+    scope->ready = INT_MAX;
+    scope->function = false;
+    scope->names = talloc(scope->capacity * sizeof(Value *));
+    scope->uses = talloc(scope->capacity * sizeof(Value *));
+    scope->flags = talloc(scope->capacity);
+    scope->captures = NULL;
+    scope->captureCount = 0;
+    scope->captureCapacity = 0;
+}
+
+// Closes the given scope, which must be the innermost open one, once nothing
+// more will be resolved in it
+void closeScope(Scope *scope) {
+    assert(openScopes == scope);
+    openScopes = scope->open;
+}
+
+// Gives the given name the next slot of the scope and returns its index
+int addName(Scope *scope, Value *name) {
+    assert(scope);
+    assert(name);
+    if(scope->count == scope->capacity) {
+        scope->capacity *= 2;
+        Value **names = talloc(scope->capacity * sizeof(Value *));
+        Value **uses = talloc(scope->capacity * sizeof(Value *));
+        char *flags = talloc(scope->capacity);
+        memcpy(names, scope->names, scope->count * sizeof(Value *));
+        memcpy(uses, scope->uses, scope->count * sizeof(Value *));
+        memcpy(flags, scope->flags, scope->count);
+        scope->names = names;
+        scope->uses = uses;
+        scope->flags = flags;
+    }
+    scope->names[scope->count] = name;
+    scope->uses[scope->count] = NULL;
+    scope->flags[scope->count] = 0;
+    scope->count++;
+    return scope->count - 1;
+}
+
+// Adds the given variable to the captures of the given lambda scope, which
+// doesn't capture it yet, with the given address, and returns its index
+int addCapture(Scope *scope, Scope *home, int slot, Value *address) {
+    assert(scope->function);
+    if(slot >= home->ready) home->flags[slot] |= LATE;
+    if(scope->captureCount == scope->captureCapacity) {
+        scope->captureCapacity = scope->captureCapacity ? scope->captureCapacity * 2 : 8;
+        Capture *captures = talloc(scope->captureCapacity * sizeof(Capture));
+        memcpy(captures, scope->captures, scope->captureCount * sizeof(Capture));
+        scope->captures = captures;
+    }
+    scope->captures[scope->captureCount].home = home;
+    scope->captures[scope->captureCount].slot = slot;
+    scope->captures[scope->captureCount].address = address;
+    home->flags[slot] |= CAPTURED;
+    return scope->captureCount++;
+}
+
+// Returns the index of the variable with the given name among the captures of
+// the given lambda scope, or -1 if it doesn't capture one. The scopes around
+// a lambda don't change while it's resolved, so the name always means the
+// same variable there.
+int findCapture(Scope *scope, Value *name) {
+    assert(scope->function);
+    for(int i = 0; i < scope->captureCount; i++) {
+        Capture *capture = &scope->captures[i];
+        if(capture->home->names[capture->slot] == name) return i;
+    }
+    return -1;
+}
+
+// Returns the slot of the newest variable with the given name in the scope,
+// or -1 if there isn't one. Hidden let* bindings are skipped unless all is
+// true.
+int findName(Scope *scope, Value *name, bool all) {
+    assert(scope);
+    for(int i = scope->count - 1; i >= 0; i--) {
+        if(!all && i >= scope->hidden && i < scope->bindings) continue;
+        if(scope->names[i] == name) return i;
+    }
+    return -1;
+}
+
+// Finds every define that runs in the frame of the given scope, so that its
+// variable gets a slot before any reference to it is resolved. Doesn't look
+// inside expressions that run in frames of their own.
+void collectDefines(Value *expr, Scope *scope) {
+    if(typeOf(expr) != CONS_TYPE) return;
+    Value *first = car(expr);
+    if(first == quoteSymbol || first == lambdaSymbol ||
+        first == letStarSymbol || first == letRecSymbol) return;
+    if(first == letSymbol) {
+        // only the initial values run in this frame
+        if(typeOf(cdr(expr)) != CONS_TYPE) return;
+        Value *bindings = car(cdr(expr));
+        while(typeOf(bindings) == CONS_TYPE) {
+            Value *binding = car(bindings);
+            if(typeOf(binding) == CONS_TYPE && typeOf(cdr(binding)) == CONS_TYPE) {
+                collectDefines(car(cdr(binding)), scope);
+            }
+            bindings = cdr(bindings);
+        }
+        return;
+    }
+    if(first == defineSymbol && length(expr) == 3) {
+        Value *name = car(cdr(expr));
+        if(typeOf(name) == SYMBOL_TYPE && findName(scope, name, true) < 0) {
+            addName(scope, name);
+        }
+    }
+    Value *cur = expr;
+    while(typeOf(cur) == CONS_TYPE) {
+        collectDefines(car(cur), scope);
+        cur = cdr(cur);
+    }
+}
+
+// Returns the address of the variable with the given name as seen from the
+// given scope, or its global cell if no enclosing scope has it, and sets home
+// and slot to where a local variable lives. Closures are flat: a variable
+// from outside the innermost lambda is captured by it, and is found among
+// the closure's captures, which make up the frame just outside the lambda's
+// own.
+Value *findVariable(Value *symbol, Scope *scope, Scope **home, int *slot) {
+    int depth = 0;
+    while(scope != NULL) {
+        int index = findName(scope, symbol, false);
+        if(index >= 0) {
+            *home = scope;
+            *slot = index;
+            return makeAddress(depth, index, index < scope->assigned, scope, index);
+        }
+        if(scope->function) {
+            int capture = findCapture(scope, symbol);
+            if(capture < 0) {
+                Value *outer = findVariable(symbol, scope->parent, home, slot);
+                if(typeOf(outer) != LOCAL_TYPE) return outer;
+                capture = addCapture(scope, *home, *slot, outer);
+            } else {
+                *home = scope->captures[capture].home;
+                *slot = scope->captures[capture].slot;
+            }
+            return makeAddress(depth + 1, capture, true, *home, *slot);
+        }
+        scope = scope->parent;
+        depth++;
+    }
+    return globalCell(symbol);
+}
+
+// Returns the address of the variable with the given name as seen from the
+// given scope, or its global cell if no enclosing scope has it
+Value *resolveVariable(Value *symbol, Scope *scope) {
+    assert(symbol);
+    assert(typeOf(symbol) == SYMBOL_TYPE);
+    Scope *home;
+    int slot;
+    return findVariable(symbol, scope, &home, &slot);
+}
+
+// Resolves each expression in the given list
+Value *resolveEach(Value *list, Scope *scope) {
+    assert(list);
+    Value *resolved = makeNull();
+    Value *cur = list;
+    while(typeOf(cur) == CONS_TYPE) {
+        resolved = cons(resolveExpr(car(cur), scope), resolved);
+        cur = cdr(cur);
+    }
+    return reverse(resolved);
+}
+
+// Rebuilds a special form from its name and its resolved arguments
+Value *makeForm(Value *name, Value *first, Value *second) {
+    return cons(name, cons(first, cons(second, makeNull())));
+}
+
+// Resolves an if expression
+// Causes an evaluation error if there are not three arguments
+Value *resolveIf(Value *args, Scope *scope) {
+    if(length(args) != 3) return makeError(1);
+    return cons(ifSymbol, resolveEach(args, scope));
+}
+
+// Checks the bindings of a let, let* or letrec expression, adding the name of
+// each valid binding to the given scope until an invalid one is found.
+// Returns the error code for the invalid binding, or 0 if they're all valid.
+int checkBindings(Value *bindings, Scope *scope) {
+    while(!isNull(bindings)) {
+        if(typeOf(bindings) != CONS_TYPE) return 5;
+        Value *binding = car(bindings);
+        if(typeOf(binding) != CONS_TYPE) return 5;
+        if(length(binding) != 2) return 5;
+        if(typeOf(car(binding)) != SYMBOL_TYPE) return 2;
+        addName(scope, car(binding));
+        bindings = cdr(bindings);
+    }
+    return 0;
+}
+
+// Resolves a let expression. The initial values before an invalid binding are
+// still evaluated, then the body causes the error.
+// Causes an evaluation error if there's not two arguments,
+//      or if the first parameter is not a list of tuples where
+//      the first value in each tuple is a valid variable name
+Value *resolveLet(Value *args, Scope *scope) {
+    if(length(args) != 2) return makeError(6);
+    Scope body;
+    initScope(&body, scope);
+    int errorCode = checkBindings(car(args), &body);
+    body.assigned = body.count;
+
+    Value *inits = makeNull();
+    Value *bindings = car(args);
+    for(int i = 0; i < body.count; i++) {
+        inits = cons(resolveExpr(car(cdr(car(bindings))), scope), inits);
+        bindings = cdr(bindings);
+    }
+    Value *expr;
+    if(errorCode) expr = makeError(errorCode);
+    else {
+        collectDefines(car(cdr(args)), &body);
+        expr = resolveExpr(car(cdr(args)), &body);
+    }
+    Value *let = makeForm(letSymbol, reverse(inits), makeBody(expr, &body));
+    closeScope(&body);
+    return let;
+}
+
+// Resolves a let* expression. Each binding comes into scope after its
+// initial value has been resolved.
+// Causes an evaluation error if there's not two arguments,
+//      or if the first parameter is not a list of tuples where
+//      the first value in each tuple is a valid variable name
+Value *resolveLetStar(Value *args, Scope *scope) {
+    if(length(args) != 2) return makeError(6);
+    Scope body;
+    initScope(&body, scope);
+    int errorCode = checkBindings(car(args), &body);
+    body.bindings = body.count;
+
+    Value *bindings = car(args);
+    for(int i = 0; i < body.bindings; i++) {
+        collectDefines(car(cdr(car(bindings))), &body);
+        bindings = cdr(bindings);
+    }
+    if(!errorCode) collectDefines(car(cdr(args)), &body);
+
+    Value *inits = makeNull();
+    bindings = car(args);
+    for(int i = 0; i < body.bindings; i++) {
+        inits = cons(resolveExpr(car(cdr(car(bindings))), &body), inits);
+        body.hidden = i + 1;
+        bindings = cdr(bindings);
+    }
+    Value *expr;
+    if(errorCode) expr = makeError(errorCode);
+    else expr = resolveExpr(car(cdr(args)), &body);
+    Value *let = makeForm(letStarSymbol, reverse(inits), makeBody(expr, &body));
+    closeScope(&body);
+    return let;
+}
+
+// Returns whether the given expression is a lambda expression
+bool isLambda(Value *expr) {
+    return typeOf(expr) == CONS_TYPE && car(expr) == lambdaSymbol;
+}
+
+// Resolves a letrec expression. Every binding is checked before any initial
+// value is evaluated. Making a closure runs nothing, so a lambda's closure
+// can capture the variables up to the first initial value after it that
+// isn't a lambda without boxes: the compiler fills in its captures as they're
+// stored.
+// Causes an evaluation error if there's not two arguments,
+//      or if the first parameter is not a list of tuples where
+//      the first value in each tuple is a valid variable name
+Value *resolveLetRec(Value *args, Scope *scope) {
+    if(length(args) != 2) return makeError(6);
+    Scope body;
+    initScope(&body, scope);
+    int errorCode = checkBindings(car(args), &body);
+    if(errorCode) {
+        closeScope(&body);
+        return makeError(errorCode);
+    }
+
+    Value *bindings = car(args);
+    while(!isNull(bindings)) {
+        collectDefines(car(cdr(car(bindings))), &body);
+        bindings = cdr(bindings);
+    }
+    collectDefines(car(cdr(args)), &body);
+
+    Value *inits = makeNull();
+    int index = 0;
+    bindings = car(args);
+    while(!isNull(bindings)) {
+        body.ready = index;
+        for(Value *cur = bindings; !isNull(cur) && isLambda(car(cdr(car(cur)))); cur = cdr(cur)) {
+            body.ready++;
+        }
+        inits = cons(resolveExpr(car(cdr(car(bindings))), &body), inits);
+        index++;
+        bindings = cdr(bindings);
+    }
+    body.ready = INT_MAX;
+    Value *expr = resolveExpr(car(cdr(args)), &body);
+    Value *let = makeForm(letRecSymbol, reverse(inits), makeBody(expr, &body));
+    closeScope(&body);
+    return let;
+}
+
+// Resolves a quote expression
+// Causes an evaluation error if there's not one argument
+Value *resolveQuote(Value *args) {
+    if(length(args) != 1) return makeError(8);
+    return cons(quoteSymbol, args);
+}
+
+// Resolves a define expression. The variable goes in the frame the define
+// runs in, which collectDefines has already given it a slot in.
+// Causes an evaluation error if there's not two arguments,
+//      or if the first argument is not a valid variable name
+Value *resolveDefine(Value *args, Scope *scope) {
+    if(length(args) != 2) return makeError(9);
+    Value *name = car(args);
+    if(typeOf(name) != SYMBOL_TYPE) return makeError(10);
+    Value *target;
+    if(scope == NULL) target = globalCell(name);
+    else {
+        int index = findName(scope, name, true);
+        if(index < 0) index = addName(scope, name);
+        target = makeAddress(0, index, index < scope->assigned, scope, index);
+        scope->flags[index] |= MUTATED;
+    }
+    return makeForm(defineSymbol, target, resolveExpr(car(cdr(args)), scope));
+}
+
+// Resolves a set! expression
+// Causes an evaluation error if there's not two arguments,
+//      or if the first argument is not a valid variable name
+Value *resolveSet(Value *args, Scope *scope) {
+    if(length(args) != 2) return makeError(9);
+    Value *name = car(args);
+    if(typeOf(name) != SYMBOL_TYPE) return makeError(10);
+    Scope *home;
+    int slot;
+    Value *target = findVariable(name, scope, &home, &slot);
+    if(typeOf(target) == LOCAL_TYPE) home->flags[slot] |= MUTATED;
+    return makeForm(setSymbol, target, resolveExpr(car(cdr(args)), scope));
+}
+
+// Resolves a lambda expression. The parameters take the first slots of the
+// frame, in order. The addresses of the variables it captures, as seen from
+// the enclosing scope, follow its body.
+// Causes an evaluation error if there's not two arguments,
+//      or if the second argument is not a list of parameters
+Value *resolveLambda(Value *args, Scope *scope) {
+    if(length(args) != 2) return makeError(11);
+    Value *params = car(args);
+    if(typeOf(params) != CONS_TYPE && !isNull(params)) return makeError(12);
+    Scope body;
+    initScope(&body, scope);
+    body.function = true;
+    Value *cur = params;
+    while(!isNull(cur)) {
+        addName(&body, car(cur));
+        cur = cdr(cur);
+    }
+    body.hidden = body.bindings = body.assigned = body.count;
+    collectDefines(car(cdr(args)), &body);
+    Value *expr = resolveExpr(car(cdr(args)), &body);
+    Value *captures = makeNull();
+    for(int i = body.captureCount - 1; i >= 0; i--) {
+        captures = cons(body.captures[i].address, captures);
+    }
+    Value *lambda = cons(makeBody(expr, &body), cons(captures, makeNull()));
+    closeScope(&body);
+    return cons(lambdaSymbol, cons(params, lambda));
+}
+
+// Resolves a cond expression. An else at the start of the last clause is
+// left alone, anywhere else it's an ordinary variable.
+Value *resolveCond(Value *args, Scope *scope) {
+    Value *clauses = makeNull();
+    Value *cur = args;
+    while(!isNull(cur)) {
+        Value *clause = car(cur);
+        if(typeOf(clause) == CONS_TYPE && isNull(cdr(cur)) && car(clause) == elseSymbol) {
+            clause = cons(elseSymbol, resolveEach(cdr(clause), scope));
+        } else if(typeOf(clause) == CONS_TYPE) clause = resolveEach(clause, scope);
+        clauses = cons(clause, clauses);
+        cur = cdr(cur);
+    }
+    return cons(condSymbol, reverse(clauses));
+}
+
+// Resolves the given expression as seen from the given scope, which is NULL
+// at the top level
+Value *resolveExpr(Value *expr, Scope *scope) {
+    assert(expr);
+    if(typeOf(expr) == SYMBOL_TYPE) return resolveVariable(expr, scope);
+    if(typeOf(expr) != CONS_TYPE) return expr;
+
+    Value *first = car(expr);
+    Value *args = cdr(expr);
+    if(first == ifSymbol) return resolveIf(args, scope);
+    if(first == condSymbol) return resolveCond(args, scope);
+    if(first == letSymbol) return resolveLet(args, scope);
+    if(first == letStarSymbol) return resolveLetStar(args, scope);
+    if(first == letRecSymbol) return resolveLetRec(args, scope);
+    if(first == quoteSymbol) return resolveQuote(args);
+    if(first == defineSymbol) return resolveDefine(args, scope);
+    if(first == setSymbol) return resolveSet(args, scope);
+    if(first == lambdaSymbol) return resolveLambda(args, scope);
+    if(first == andSymbol || first == orSymbol || first == beginSymbol) {
+        return cons(first, resolveEach(args, scope));
+    }
+    return resolveEach(expr, scope);
+}
+
+// Resolves a top level expression
+Value *resolve(Value *expr) {
+    assert(expr);
+    openScopes = NULL;
+    return resolveExpr(expr, NULL);
+}
@@ -0,0 +1,34 @@
+#include "value.h"
+
+#ifndef _RESOLVER
+#define _RESOLVER
+
+// The interned names of the special forms and of else, so that they can be
+// recognized by comparing pointers
+extern Value *ifSymbol, *condSymbol, *andSymbol, *orSymbol, *letSymbol;
+extern Value *letStarSymbol, *letRecSymbol, *quoteSymbol, *defineSymbol;
+extern Value *setSymbol, *lambdaSymbol, *beginSymbol, *elseSymbol;
+
+// The head of (box (slot ...) expr), which wraps the body of a frame whose
+// given slots hold boxes
+extern Value *boxSymbol;
+
+// Interns the special form names and sets up the global table. Must be called
+// before anything else in this file.
+void initResolver();
+
+// Returns the cell holding the global variable with the given name. A cell is
+// a BINDING_TYPE Value whose var is the name and whose val is the value, or
+// NULL while the variable is undefined. Cells never move.
+Value *globalCell(Value *symbol);
+
+// Returns a copy of the given expression in which every variable reference
+// has been replaced by a LOCAL_TYPE address of a frame slot or by a global
+// cell, and the body of every lambda, let, let* and letrec is wrapped in a
+// BODY_TYPE Value holding the size of the frame it runs in. Each lambda is
+// followed by the addresses of the variables its closures capture. Malformed special
+// forms are replaced by ERROR_TYPE Values at the point where evaluating them
+// would have failed.
+Value *resolve(Value *expr);
+
+#endif
@@ -0,0 +1,280 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "scan.h"
+
+// The scanners test 16 or 32 characters at a time with SSE2 or AVX2 on x86-64
+// compilers that can target both, picking the widest the processor supports
+// at run time. Everywhere else, or with NO_SIMD, they go a character at a time.
+// Most runs of spaces or symbol characters are short, so the wide scanners for
+// those test the first character on its own before loading any vectors.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(NO_SIMD)
+#define X86_SIMD
+#include <immintrin.h>
+#endif
+
+// The classes of a character, written out once here so that the table below
+// is filled in by the compiler
+#define IS_LETTER(c) (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z'))
+#define IS_NUMBER(c) (((c) >= '0' && (c) <= '9') || (c) == '.')
+#define IS_INITIAL(c) ((c) == '!' || (c) == '$' || (c) == '%' || (c) == '*' || \
+    (c) == '/' || (c) == ':' || (c) == '<' || (c) == '=' || (c) == '>' || \
+    (c) == '?' || (c) == '~' || (c) == '_' || (c) == '^' || (c) == '&' || IS_LETTER(c))
+#define IS_SUBSEQUENT(c) ((c) == '+' || (c) == '-' || IS_INITIAL(c) || IS_NUMBER(c))
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\n')
+// 0xff is what EOF becomes when it's read into a char
+#define IS_BLANK(c) (IS_SPACE(c) || (c) == '(' || (c) == ')' || (c) == '\"' || (c) == 0xff)
+
+#define CLASS_OF(c) ((IS_NUMBER(c) ? NUMBER_CLASS : 0) | \
+    (IS_INITIAL(c) ? INITIAL_CLASS : 0) | (IS_SUBSEQUENT(c) ? SUBSEQUENT_CLASS : 0) | \
+    (IS_BLANK(c) ? BLANK_CLASS : 0) | (IS_SPACE(c) ? SPACE_CLASS : 0))
+#define CLASS_ROW(r) CLASS_OF(r), CLASS_OF(r + 1), CLASS_OF(r + 2), CLASS_OF(r + 3), \
+    CLASS_OF(r + 4), CLASS_OF(r + 5), CLASS_OF(r + 6), CLASS_OF(r + 7), \
+    CLASS_OF(r + 8), CLASS_OF(r + 9), CLASS_OF(r + 10), CLASS_OF(r + 11), \
+    CLASS_OF(r + 12), CLASS_OF(r + 13), CLASS_OF(r + 14), CLASS_OF(r + 15)
+
+const unsigned char charClass[256] = {
+    CLASS_ROW(0x00), CLASS_ROW(0x10), CLASS_ROW(0x20), CLASS_ROW(0x30),
+    CLASS_ROW(0x40), CLASS_ROW(0x50), CLASS_ROW(0x60), CLASS_ROW(0x70),
+    CLASS_ROW(0x80), CLASS_ROW(0x90), CLASS_ROW(0xa0), CLASS_ROW(0xb0),
+    CLASS_ROW(0xc0), CLASS_ROW(0xd0), CLASS_ROW(0xe0), CLASS_ROW(0xf0)
+};
+
+// Returns whether the given character is in the given classes
+static inline int inClass(char c, int classes) {
+    return charClass[(unsigned char)c] & classes;
+}
+
+// Spans spaces and newlines a character at a time
+size_t spanSpacesScalar(const char *text, size_t length) {
+    size_t i = 0;
+    while(i < length && inClass(text[i], SPACE_CLASS)) i++;
+    return i;
+}
+
+// Spans symbol characters a character at a time
+size_t spanSymbolScalar(const char *text, size_t length) {
+    size_t i = 0;
+    while(i < length && inClass(text[i], SUBSEQUENT_CLASS)) i++;
+    return i;
+}
+
+// Spans up to a newline a character at a time
+size_t spanLineScalar(const char *text, size_t length) {
+    size_t i = 0;
+    while(i < length && text[i] != '\n') i++;
+    return i;
+}
+
+// Spans up to a double quote or a newline a character at a time
+size_t spanStringScalar(const char *text, size_t length) {
+    size_t i = 0;
+    while(i < length && text[i] != '\"' && text[i] != '\n') i++;
+    return i;
+}
+
+size_t (*spanSpaces)(const char *text, size_t length) = spanSpacesScalar;
+size_t (*spanSymbol)(const char *text, size_t length) = spanSymbolScalar;
+size_t (*spanLine)(const char *text, size_t length) = spanLineScalar;
+size_t (*spanString)(const char *text, size_t length) = spanStringScalar;
+
+#ifdef X86_SIMD
+
+// Every character from '!' to '~' that can't be in a symbol. SSE2 has no
+// table lookup, so its symbol scanner compares against each of these.
+char symbolExclusions[128];
+int symbolExclusionCount = 0;
+
+// Tables for looking up whether a character can be in a symbol from its two
+// halves with AVX2's byte shuffle. Each character with high half h is given
+// bit h, and a character can be in a symbol if the entry for its low half has
+// that bit set. Characters from 0x80 up have no bit, so never match.
+uint8_t symbolLowHalves[16];
+uint8_t symbolHighHalves[16];
+
+// Fills in the tables the SIMD symbol scanners use from charClass
+void initSymbolTables() {
+    symbolExclusionCount = 0;
+    for(int c = '!'; c <= '~'; c++) {
+        if(!inClass(c, SUBSEQUENT_CLASS)) symbolExclusions[symbolExclusionCount++] = c;
+    }
+    for(int h = 0; h < 16; h++) {
+        symbolLowHalves[h] = 0;
+        symbolHighHalves[h] = h < 8 ? 1 << h : 0;
+    }
+    for(int c = 0; c < 128; c++) {
+        if(inClass(c, SUBSEQUENT_CLASS)) symbolLowHalves[c & 0xf] |= 1 << (c >> 4);
+    }
+}
+
+// Spans spaces and newlines 16 characters at a time
+__attribute__((target("sse2")))
+size_t spanSpacesSSE2(const char *text, size_t length) {
+    if(length == 0 || !inClass(text[0], SPACE_CLASS)) return 0;
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for(; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(text + i));
+        unsigned accepted = _mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, newline)));
+        if(accepted != 0xffff) return i + __builtin_ctz(~accepted);
+    }
+    return i + spanSpacesScalar(text + i, length - i);
+}
+
+// Spans symbol characters 16 characters at a time
+__attribute__((target("sse2")))
+size_t spanSymbolSSE2(const char *text, size_t length) {
+    if(length == 0 || !inClass(text[0], SUBSEQUENT_CLASS)) return 0;
+    const __m128i below = _mm_set1_epi8('!' - 1);
+    const __m128i above = _mm_set1_epi8('~' + 1);
+    size_t i = 0;
+    for(; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(text + i));
+        // characters from 0x80 up are negative, so fail the first test
+        __m128i accepted = _mm_and_si128(_mm_cmpgt_epi8(chunk, below),
+            _mm_cmplt_epi8(chunk, above));
+        for(int j = 0; j < symbolExclusionCount; j++) {
+            accepted = _mm_andnot_si128(
+                _mm_cmpeq_epi8(chunk, _mm_set1_epi8(symbolExclusions[j])), accepted);
+        }
+        unsigned mask = _mm_movemask_epi8(accepted);
+        if(mask != 0xffff) return i + __builtin_ctz(~mask);
+    }
+    return i + spanSymbolScalar(text + i, length - i);
+}
+
+// Spans up to a newline 16 characters at a time
+__attribute__((target("sse2")))
+size_t spanLineSSE2(const char *text, size_t length) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for(; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(text + i));
+        unsigned stops = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        if(stops) return i + __builtin_ctz(stops);
+    }
+    return i + spanLineScalar(text + i, length - i);
+}
+
+// Spans up to a double quote or a newline 16 characters at a time
+__attribute__((target("sse2")))
+size_t spanStringSSE2(const char *text, size_t length) {
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for(; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(text + i));
+        unsigned stops = _mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, newline)));
+        if(stops) return i + __builtin_ctz(stops);
+    }
+    return i + spanStringScalar(text + i, length - i);
+}
+
+// Spans spaces and newlines 32 characters at a time
+__attribute__((target("avx2")))
+size_t spanSpacesAVX2(const char *text, size_t length) {
+    if(length == 0 || !inClass(text[0], SPACE_CLASS)) return 0;
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for(; i + 32 <= length; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(text + i));
+        unsigned accepted = _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, newline)));
+        if(accepted != 0xffffffff) return i + __builtin_ctz(~accepted);
+    }
+    return i + spanSpacesSSE2(text + i, length - i);
+}
+
+// Spans symbol characters 32 characters at a time
+__attribute__((target("avx2")))
+size_t spanSymbolAVX2(const char *text, size_t length) {
+    if(length == 0 || !inClass(text[0], SUBSEQUENT_CLASS)) return 0;
+    const __m256i lowTable = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)symbolLowHalves));
+    const __m256i highTable = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)symbolHighHalves));
+    const __m256i halfMask = _mm256_set1_epi8(0xf);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 32 <= length; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(text + i));
+        __m256i low = _mm256_and_si256(chunk, halfMask);
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(chunk, 4), halfMask);
+        __m256i bits = _mm256_and_si256(_mm256_shuffle_epi8(lowTable, low),
+            _mm256_shuffle_epi8(highTable, high));
+        unsigned rejected = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bits, zero));
+        if(rejected) return i + __builtin_ctz(rejected);
+    }
+    return i + spanSymbolSSE2(text + i, length - i);
+}
+
+// Spans up to a newline 32 characters at a time
+__attribute__((target("avx2")))
+size_t spanLineAVX2(const char *text, size_t length) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for(; i + 32 <= length; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(text + i));
+        unsigned stops = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline));
+        if(stops) return i + __builtin_ctz(stops);
+    }
+    return i + spanLineSSE2(text + i, length - i);
+}
+
+// Spans up to a double quote or a newline 32 characters at a time
+__attribute__((target("avx2")))
+size_t spanStringAVX2(const char *text, size_t length) {
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for(; i + 32 <= length; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(text + i));
+        unsigned stops = _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, newline)));
+        if(stops) return i + __builtin_ctz(stops);
+    }
+    return i + spanStringSSE2(text + i, length - i);
+}
+
+#endif
+
+// Picks the fastest scanners the processor can run, up to the given level
+scanLevel initScanner(scanLevel max) {
+    scanLevel level = SCALAR_SCAN;
+#ifdef X86_SIMD
+    // every x86-64 processor has SSE2
+    __builtin_cpu_init();
+    if(max >= SSE2_SCAN) level = SSE2_SCAN;
+    if(max >= AVX2_SCAN && __builtin_cpu_supports("avx2")) level = AVX2_SCAN;
+    if(level != SCALAR_SCAN) initSymbolTables();
+    if(level == AVX2_SCAN) {
+        spanSpaces = spanSpacesAVX2;
+        spanSymbol = spanSymbolAVX2;
+        spanLine = spanLineAVX2;
+        spanString = spanStringAVX2;
+        return level;
+    }
+    if(level == SSE2_SCAN) {
+        spanSpaces = spanSpacesSSE2;
+        spanSymbol = spanSymbolSSE2;
+        spanLine = spanLineSSE2;
+        spanString = spanStringSSE2;
+        return level;
+    }
+#endif
+    spanSpaces = spanSpacesScalar;
+    spanSymbol = spanSymbolScalar;
+    spanLine = spanLineScalar;
+    spanString = spanStringScalar;
+    return level;
+}
+
+// Returns the name of the given level
+char *scanLevelName(scanLevel level) {
+    if(level == AVX2_SCAN) return "avx2";
+    if(level == SSE2_SCAN) return "sse2";
+    return "scalar";
+}
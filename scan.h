@@ -0,0 +1,45 @@
+#include <stddef.h>
+
+#ifndef _SCAN
+#define _SCAN
+
+// The classes of characters the tokenizer tells apart, as bits of the entries
+// of charClass. A character can be in several classes.
+#define NUMBER_CLASS 1      // digits and '.'
+#define INITIAL_CLASS 2     // characters that can start a symbol
+#define SUBSEQUENT_CLASS 4  // characters that can be in the rest of a symbol
+#define BLANK_CLASS 8       // characters that end a token
+#define SPACE_CLASS 16      // characters between tokens
+
+// The classes of each character, indexed by the character as an unsigned
+// char. EOF converted to a char is blank.
+extern const unsigned char charClass[256];
+
+// The instruction sets the scanners can use, from the slowest up
+typedef enum {SCALAR_SCAN,SSE2_SCAN,AVX2_SCAN} scanLevel;
+
+// Picks the fastest scanners the processor can run, but none faster than the
+// given level, and returns the level picked. Until this is called the scalar
+// scanners are used.
+scanLevel initScanner(scanLevel max);
+
+// Returns the name of the given level
+char *scanLevelName(scanLevel level);
+
+// The scanners each take some text and its length and return the length of
+// the run of characters they accept at its start. A result equal to the
+// length means the run might carry on past the text.
+
+// Spans the spaces and newlines between tokens
+extern size_t (*spanSpaces)(const char *text, size_t length);
+
+// Spans the characters that can be in the rest of a symbol
+extern size_t (*spanSymbol)(const char *text, size_t length);
+
+// Spans everything up to a newline, for comments
+extern size_t (*spanLine)(const char *text, size_t length);
+
+// Spans everything up to a double quote or a newline, for strings
+extern size_t (*spanString)(const char *text, size_t length);
+
+#endif
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "talloc.h"
+#include "source.h"
+
+// How much is read at a time from input that can't be mapped
+#define BLOCK_SIZE (64 * 1024)
+
+// Makes the given source read from the given file descriptor
+void openSource(Source *source, int fd) {
+    source->data = NULL;
+    source->length = 0;
+    source->capacity = 0;
+    source->pos = 0;
+    source->mark = 0;
+    source->fd = fd;
+    source->mapped = false;
+    source->interactive = isatty(fd);
+    source->prompt = "";
+    source->continuation = "";
+    struct stat info;
+    if(fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) return;
+
+    // mapping starts at the beginning of the file, so skip whatever was
+    // already read from the descriptor, like a shell does for scripts
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if(offset < 0) offset = 0;
+    if(info.st_size == 0) {
+        source->fd = -1;
+        return;
+    }
+    char *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) return;
+    source->data = data;
+    source->length = info.st_size;
+    source->capacity = info.st_size;
+    source->pos = offset < info.st_size ? offset : info.st_size;
+    source->fd = -1;
+    source->mapped = true;
+}
+
+// Reads more text into the given source
+bool fillSource(Source *source) {
+    if(source->fd < 0) return false;
+
+    // nothing points into the text before the mark, so it can be dropped
+    if(source->mark > 0) {
+        memmove(source->data, source->data + source->mark, source->length - source->mark);
+        source->length -= source->mark;
+        source->pos -= source->mark;
+        source->mark = 0;
+    }
+    if(source->length + BLOCK_SIZE > source->capacity) {
+        source->capacity = source->capacity * 2 > source->length + BLOCK_SIZE ?
+            source->capacity * 2 : source->length + BLOCK_SIZE;
+        source->data = realloc(source->data, source->capacity);
+        if(source->data == NULL) texit(1);
+    }
+
+    if(source->interactive) {
+        printf("%s", source->prompt);
+        fflush(stdout);
+        source->prompt = source->continuation;
+    }
+    ssize_t count = read(source->fd, source->data + source->length,
+        source->capacity - source->length);
+    if(count < 0) {
+        printf("Could not read the input\n");
+        texit(1);
+    }
+    if(count == 0) {
+        source->fd = -1;
+        return false;
+    }
+    source->length += count;
+    return true;
+}
+
+// Drops whatever has been read but not tokenized yet
+void discardSource(Source *source) {
+    source->pos = source->length;
+    source->mark = source->length;
+}
+
+// Releases the text of the given source
+void closeSource(Source *source) {
+    if(source->mapped) munmap(source->data, source->length);
+    else free(source->data);
+    source->data = NULL;
+    source->length = 0;
+    source->capacity = 0;
+    source->pos = 0;
+    source->mark = 0;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef _SOURCE
+#define _SOURCE
+
+// The text of a program, with the position the tokenizer has read up to.
+// Regular files are mapped into memory whole, so tokens can point straight
+// into the text instead of copying it, and the text stays in place until
+// closeSource. Anything else, like a pipe or a terminal, is read a block at a
+// time as the tokenizer needs it; the text before mark, where the token being
+// read starts, is dropped to make room, so tokens must copy what they keep.
+// An interactive source prints prompt before waiting for a line, and
+// continuation before any more lines it waits for until prompt is set again.
+typedef struct Source Source;
+struct Source {
+    char *data;
+    size_t length;
+    size_t capacity;
+    size_t pos;
+    size_t mark;
+    int fd;
+    bool mapped;
+    bool interactive;
+    char *prompt;
+    char *continuation;
+};
+
+// Makes the given source read from the given file descriptor. If it's a
+// terminal, the source is interactive.
+void openSource(Source *source, int fd);
+
+// Reads more text into the given source, dropping the text before its mark.
+// Returns false at the end of the input.
+bool fillSource(Source *source);
+
+// Drops whatever has been read into the given source but not tokenized yet
+void discardSource(Source *source);
+
+// Releases the text of the given source. Tokens that point into it are
+// invalid afterwards.
+void closeSource(Source *source);
+
+// Returns the next character of the given source without moving past it, or
+// EOF at the end of the input
+static inline int peekChar(Source *source) {
+    if(source->pos >= source->length && !fillSource(source)) return EOF;
+    return source->data[source->pos];
+}
+
+// Returns the next character of the given source and moves past it, or EOF at
+// the end of the input
+static inline int nextChar(Source *source) {
+    if(source->pos >= source->length && !fillSource(source)) return EOF;
+    return source->data[source->pos++];
+}
+
+#endif
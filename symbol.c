@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "value.h"
+#include "talloc.h"
+#include "gc.h"
+#include "symbol.h"
+
+// Open addressing hash table holding every symbol ever interned
+Value **symbols = NULL;
+size_t symbolCapacity = 0;
+size_t symbolCount = 0;
+
+// Returns the FNV-1a hash of the given characters
+size_t hashName(char *name, size_t length) {
+    size_t hash = 14695981039346656037ull;
+    for(size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Returns the slot of the table that holds the symbol with the given name, or
+// the empty slot where it should go
+size_t symbolSlot(char *name, size_t length) {
+    size_t mask = symbolCapacity - 1;
+    size_t i = hashName(name, length) & mask;
+    while(symbols[i] != NULL) {
+        char *s = symbols[i]->s;
+        if(!strncmp(s, name, length) && s[length] == '\0') break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+// Visits every symbol for the garbage collector
+void visitSymbols() {
+    for(size_t i = 0; i < symbolCapacity; i++) {
+        if(symbols[i] != NULL) gcVisit((void **)&symbols[i]);
+    }
+}
+
+// Doubles the size of the table and reinserts every symbol
+void growSymbols() {
+    Value **old = symbols;
+    size_t oldCapacity = symbolCapacity;
+    if(symbols == NULL) gcAddRoots(visitSymbols);
+    symbolCapacity = symbolCapacity ? symbolCapacity * 2 : 256;
+    symbols = (Value **)talloc(symbolCapacity * sizeof(Value *));
+    memset(symbols, 0, symbolCapacity * sizeof(Value *));
+    for(size_t i = 0; i < oldCapacity; i++) {
+        if(old[i] == NULL) continue;
+        symbols[symbolSlot(old[i]->s, strlen(old[i]->s))] = old[i];
+    }
+}
+
+// Returns the symbol with the given name, creating it if it doesn't exist.
+// Symbols live in the old generation so that they never move.
+Value *internLength(char *name, size_t length) {
+    assert(name);
+    if((symbolCount + 1) * 2 > symbolCapacity) growSymbols();
+    size_t slot = symbolSlot(name, length);
+    if(symbols[slot] != NULL) return symbols[slot];
+
+    char *copy = talloc(length + 1);
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+    Value *symbol = (Value *)gcAllocOld(sizeof(Value), VALUE_OBJECT);
+    symbol->type = SYMBOL_TYPE;
+    symbol->s = copy;
+    symbols[slot] = symbol;
+    symbolCount++;
+    return symbol;
+}
+
+// Returns the symbol with the given null terminated name
+Value *intern(char *name) {
+    assert(name);
+    return internLength(name, strlen(name));
+}
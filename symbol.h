@@ -0,0 +1,18 @@
+#include <stddef.h>
+#include "value.h"
+
+#ifndef _SYMBOL
+#define _SYMBOL
+
+// Returns the FNV-1a hash of the given characters
+size_t hashName(char *name, size_t length);
+
+// Returns the one SYMBOL_TYPE Value with the given name, creating it the first
+// time the name is seen. Symbols can therefore be compared with ==.
+Value *intern(char *name);
+
+// Like intern, but the name is the given number of characters starting at
+// name and doesn't need to be null terminated
+Value *internLength(char *name, size_t length);
+
+#endif
@@ -1,56 +1,84 @@
-#include <stdlib.h>
-#include <stdbool.h>
-#include "value.h"
-
-Value *head;
-bool initialized = false;
-
-// Creates a new CONS_TYPE value node where the car is a PTR_TYPE Value and the cdr is null
-Value *initPointerValue(void *p) {
-    Value *pointerValue = (Value *)malloc(sizeof(Value));
-    pointerValue->type = PTR_TYPE;
-    pointerValue->p = p;
-
-    Value *consValue = (Value *)malloc(sizeof(Value));
-    consValue->type = CONS_TYPE;
-    consValue->c.car = pointerValue;
-    consValue->c.cdr = NULL;
-    return consValue;
-}
-
-// Mallocs space of the given size and tracks the pointer in a linked list
-void *talloc(size_t size) {
-    void *p = malloc(size);
-    Value *n = initPointerValue(p);
-    if(!initialized) {
-        head = n;
-        initialized = true;
-    } else {
-        Value *cur = head;
-        while(cur->c.cdr != NULL) {
-            cur = cur->c.cdr;
-        }
-        cur->c.cdr = n;
-    }
-    return p;
-}
-
-// Frees all the pointers tracked in the linked list as well as the linked list itself
-void tfree() {
-    Value *cur = head;
-    Value *next;
-    while(cur != NULL) {
-        next = cur->c.cdr;
-        free(cur->c.car->p);
-        free(cur->c.car);
-        free(cur);
-        cur = next;
-    }
-    initialized = false;
-}
-
-// Frees all memory and then exits the program
-void texit(int status) {
-    tfree();
-    exit(status);
-}
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include "value.h"
+#include "gc.h"
+
+// Memory is handed out from large slabs by bumping a pointer, so an allocation
+// is a couple of additions and a compare. Slabs are kept in a singly linked
+// list so that tfree can give all of them back at once.
+#define SLAB_SIZE (256 * 1024)
+#define ALIGNMENT (_Alignof(max_align_t))
+
+typedef struct Slab Slab;
+struct Slab {
+    Slab *next;
+    max_align_t data[];
+};
+
+Slab *slabs = NULL;
+char *bump = NULL;
+char *limit = NULL;
+
+// Where texit jumps to instead of exiting, if anywhere
+jmp_buf *exitHandler = NULL;
+
+// Rounds the given size up to the allocation alignment
+size_t alignUp(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+// Mallocs a new slab with room for at least the given number of bytes and
+// puts it at the front of the slab list
+Slab *newSlab(size_t size) {
+    Slab *slab = (Slab *)malloc(sizeof(Slab) + size);
+    if(slab == NULL) exit(1);
+    slab->next = slabs;
+    slabs = slab;
+    return slab;
+}
+
+// Returns size bytes of memory from the current slab, starting a new slab if
+// the current one is full. Requests bigger than a quarter of a slab get a slab
+// of their own so that they don't waste the rest of the current one.
+void *talloc(size_t size) {
+    size = alignUp(size == 0 ? 1 : size);
+    if(size > (size_t)(limit - bump)) {
+        if(size > SLAB_SIZE / 4) return newSlab(size)->data;
+        Slab *slab = newSlab(SLAB_SIZE);
+        bump = (char *)slab->data;
+        limit = bump + SLAB_SIZE;
+    }
+    void *p = bump;
+    bump += size;
+    return p;
+}
+
+// Frees every slab, along with the garbage collected heap
+void tfree() {
+    gcFreeAll();
+    Slab *cur = slabs;
+    Slab *next;
+    while(cur != NULL) {
+        next = cur->next;
+        free(cur);
+        cur = next;
+    }
+    slabs = NULL;
+    bump = NULL;
+    limit = NULL;
+}
+
+// Frees all memory and then exits the program, unless there's an exit
+// handler to jump to
+void texit(int status) {
+    if(exitHandler != NULL) longjmp(*exitHandler, status);
+    tfree();
+    exit(status);
+}
+
+// Sets where texit jumps to instead of exiting
+void setExitHandler(jmp_buf *handler) {
+    exitHandler = handler;
+}
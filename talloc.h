@@ -1,18 +1,18 @@
 #include <stdlib.h>
+#include <setjmp.h>
 #include "value.h"
 
 #ifndef _TALLOC
 #define _TALLOC
 
-// Replacement for malloc that stores the pointers allocated. It should store
-// the pointers in some kind of list; a linked list would do fine, but insert
-// here whatever code you'll need to do so; don't call functions in the
-// pre-existing linkedlist.h. Otherwise you'll end up with circular
-// dependencies, since you're going to modify the linked list to use talloc.
+// Replacement for malloc that bump allocates out of large slabs, so that
+// allocation is constant time and needs no bookkeeping per pointer. The
+// returned memory is aligned for any type. Don't call functions in
+// linkedlist.h from here, since the linked list is built on top of talloc.
 void *talloc(size_t size);
 
-// Free all pointers allocated by talloc, as well as whatever memory you
-// allocated in lists to hold those pointers.
+// Free every slab handed out by talloc, and the garbage collected heap with
+// them. All pointers returned by talloc or gcAlloc are invalid afterwards.
 void tfree();
 
 // Replacement for the C function "exit", that consists of two lines: it calls
@@ -20,5 +20,10 @@ void tfree();
 // you can exit your program, and all memory is automatically cleaned up.
 void texit(int status);
 
+// Makes texit jump to the given handler with its status instead of exiting,
+// so that an interactive session can carry on after an error. NULL makes it
+// exit again.
+void setExitHandler(jmp_buf *handler);
+
 #endif
 
@@ -0,0 +1,99 @@
+#include <string.h>
+#include <assert.h>
+#include "value.h"
+#include "gc.h"
+#include "text.h"
+
+// The size of the buffer a string port starts out with
+#define PORT_CAPACITY 32
+
+// Creates a STR_TYPE Value holding a copy of the given characters. They're
+// allocated first, so the string is never older than them.
+Value *makeString(char *chars, size_t length) {
+    assert(length <= STRING_MAX);
+    char *copy = gcAlloc(length, RAW_OBJECT);
+    memcpy(copy, chars, length);
+    return shareString(copy, length);
+}
+
+// Creates a STR_TYPE Value for the given characters without copying them
+Value *shareString(char *chars, size_t length) {
+    assert(chars);
+    assert(length <= STRING_MAX);
+    Value *string = gcAllocValue();
+    string->type = STR_TYPE;
+    string->str.chars = chars;
+    string->str.start = 0;
+    string->str.length = length;
+    return string;
+}
+
+// Returns the part of the string from start to end, sharing its characters.
+// The collector only follows pointers to the start of an object, so the
+// substring keeps the same chars and moves its start instead.
+Value *substring(Value *string, size_t start, size_t end) {
+    assert(typeOf(string) == STR_TYPE);
+    assert(start <= end && end <= string->str.length);
+    Value *part = gcAllocValue();
+    part->type = STR_TYPE;
+    part->str.chars = string->str.chars;
+    part->str.start = string->str.start + start;
+    part->str.length = end - start;
+    return part;
+}
+
+// Returns a new string made of the given strings, copying each of them once
+Value *stringAppend(int count, Value **strings) {
+    size_t length = 0;
+    for(int i = 0; i < count; i++) {
+        assert(typeOf(strings[i]) == STR_TYPE);
+        length += strings[i]->str.length;
+    }
+    assert(length <= STRING_MAX);
+    char *chars = gcAlloc(length, RAW_OBJECT);
+    size_t end = 0;
+    for(int i = 0; i < count; i++) {
+        memcpy(chars + end, stringChars(strings[i]), strings[i]->str.length);
+        end += strings[i]->str.length;
+    }
+    return shareString(chars, length);
+}
+
+// Creates an empty string port with room for PORT_CAPACITY characters
+Value *makeStringPort() {
+    char *chars = gcAlloc(PORT_CAPACITY, RAW_OBJECT);
+    Value *port = gcAllocValue();
+    port->type = STRING_PORT_TYPE;
+    port->port.chars = chars;
+    port->port.length = 0;
+    port->port.capacity = PORT_CAPACITY;
+    return port;
+}
+
+// Adds the given characters to the text of the port. A full buffer is
+// replaced by one twice as big, or as big as needed, so writing n characters
+// in all copies O(n) of them. Strings already taken from the port keep the
+// old buffer.
+void portWrite(Value *port, char *chars, size_t length) {
+    assert(typeOf(port) == STRING_PORT_TYPE);
+    size_t needed = (size_t)port->port.length + length;
+    assert(needed <= STRING_MAX);
+    if(needed > port->port.capacity) {
+        size_t capacity = (size_t)port->port.capacity * 2;
+        if(capacity < needed) capacity = needed;
+        if(capacity > STRING_MAX) capacity = STRING_MAX;
+        char *buffer = gcAlloc(capacity, RAW_OBJECT);
+        memcpy(buffer, port->port.chars, port->port.length);
+        port->port.chars = buffer;
+        port->port.capacity = capacity;
+        gcWriteBarrier(port, buffer);
+    }
+    memcpy(port->port.chars + port->port.length, chars, length);
+    port->port.length = needed;
+}
+
+// Returns a string sharing the text written to the port so far
+Value *portString(Value *port) {
+    assert(typeOf(port) == STRING_PORT_TYPE);
+    return shareString(port->port.chars, port->port.length);
+}
@@ -0,0 +1,48 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "value.h"
+#include "gc.h"
+
+#ifndef _TEXT
+#define _TEXT
+
+// The most characters a string or string port can hold: their characters
+// are a single object of the collector, whose size is limited
+#define STRING_MAX GC_MAX_SIZE
+
+// Returns the first character of the given string. Strings don't end with a
+// null character, so their length must be used instead.
+static inline char *stringChars(Value *string) {
+    return string->str.chars + string->str.start;
+}
+
+// Creates a STR_TYPE Value holding a copy of the given number of characters
+Value *makeString(char *chars, size_t length);
+
+// Creates a STR_TYPE Value for the given number of characters starting at
+// chars, which must stay in place and unchanged for as long as the string
+// can be reached: characters the collector owns, or ones it never frees
+Value *shareString(char *chars, size_t length);
+
+// Returns the characters of the given string from start up to but not
+// including end. The new string shares the characters of the old one.
+Value *substring(Value *string, size_t start, size_t end);
+
+// Returns a new string holding the characters of the given strings one after
+// the other. Its characters are allocated once, at their total length, which
+// must be at most STRING_MAX.
+Value *stringAppend(int count, Value **strings);
+
+// Creates an empty STRING_PORT_TYPE Value, which collects the text written to
+// it in a buffer that doubles in size whenever it fills up
+Value *makeStringPort();
+
+// Adds the given number of characters to the end of the text of the port,
+// which must end up at most STRING_MAX characters long
+void portWrite(Value *port, char *chars, size_t length);
+
+// Returns a string holding the text written to the port so far. It shares
+// the port's buffer, since later writes only add characters after it.
+Value *portString(Value *port);
+
+#endif
@@ -1,11 +1,18 @@
 #include "value.h"
+#include "source.h"
 
 #ifndef _TOKENIZER
 #define _TOKENIZER
 
-// Read all of the input from stdin, and return a linked list consisting of the
-// tokens.
-Value *tokenize();
+// Reads the next token from the given source and returns it, or NULL at the
+// end of the input. The character that ends a token is left unread, so
+// nothing past the token is waited for. Strings point into the source's text
+// if it stays in place.
+Value *readToken(Source *source);
+
+// Read all of the given source, and return a linked list consisting of the
+// tokens. Strings among the tokens point into the source's text.
+Value *tokenize(Source *source);
 
 // Displays the contents of the linked list as tokens, with type information
 void displayTokens(Value *list);
@@ -1,17 +1,34 @@
+#include <stddef.h>
+#include <stdint.h>
+
 #ifndef _VALUE
 #define _VALUE
 
 typedef enum {INT_TYPE,DOUBLE_TYPE,STR_TYPE,CONS_TYPE,NULL_TYPE,PTR_TYPE,
     OPEN_TYPE,CLOSE_TYPE,BOOL_TYPE,SYMBOL_TYPE,BINDING_TYPE,VOID_TYPE,
-    CLOSURE_TYPE,PRIMITIVE_TYPE} valueType;
+    CLOSURE_TYPE,PRIMITIVE_TYPE,LOCAL_TYPE,BODY_TYPE,ERROR_TYPE,BIGNUM_TYPE,
+    VECTOR_TYPE,OPEN_VECTOR_TYPE,HASH_TABLE_TYPE,STRING_PORT_TYPE} valueType;
 
+// hash is the number that eq? hash tables hash the Value by, since the
+// collector may move it. It's 0 until the Value is first hashed.
 struct Value {
     valueType type;
+    uint32_t hash;
     union {
         int i;
         double d;
         char *s;
         void *p;
+        struct String {
+            char *chars;
+            uint32_t start;
+            uint32_t length;
+        } str;
+        struct StringPort {
+            char *chars;
+            uint32_t length;
+            uint32_t capacity;
+        } port;
         struct ConsCell {
             struct Value *car;
             struct Value *cdr;
@@ -20,16 +37,76 @@ struct Value {
             struct Value *var;
             struct Value *val;
         } b;
+        struct Address {
+            unsigned depth : 30;
+            unsigned assigned : 1;
+            unsigned boxed : 1;
+            int index;
+            struct Value *next;
+        } a;
+        struct Body {
+            int frameSize;
+            struct Value *expr;
+        } body;
+        struct Bignum {
+            int sign;
+            int length;
+            uint32_t *digits;
+        } big;
+        struct Vector {
+            int length;
+            struct Value **items;
+        } vec;
+        struct HashTable {
+            int count;
+            unsigned int capacity : 30;
+            unsigned int test : 2;
+            struct Value **slots;
+        } ht;
         struct Closure {
-            struct Value *paramNames;
-            struct Value *functionCode;
+            struct Code *code;
             struct Frame *frame;
         } cl;
-        struct Value *(*pf)(struct Value *);
+        struct Primitive {
+            struct Value *(*function)(int argc, struct Value **argv);
+            short minArgs;
+            short maxArgs;
+            short arityError;
+            short fixnumOp;
+        } prim;
     };
 };
 
 
 typedef struct Value Value;
 
+// Integers are not allocated: a Value pointer with its low bit set holds the
+// integer in its other bits. Real Values are always at least 2-byte aligned,
+// so the two can't be confused. Code that may be handed an integer must use
+// typeOf instead of reading the type field.
+#define FIXNUM_TAG 1
+#define FIXNUM_MIN (INTPTR_MIN >> 1)
+#define FIXNUM_MAX (INTPTR_MAX >> 1)
+
+// Returns whether the given value is an immediate integer
+static inline int isFixnum(Value *value) {
+    return ((uintptr_t)value & FIXNUM_TAG) != 0;
+}
+
+// Returns the immediate integer for the given number, which must be between
+// FIXNUM_MIN and FIXNUM_MAX
+static inline Value *makeFixnum(intptr_t n) {
+    return (Value *)(((uintptr_t)n << 1) | FIXNUM_TAG);
+}
+
+// Returns the number held by the given immediate integer
+static inline intptr_t fixnumValue(Value *value) {
+    return (intptr_t)value >> 1;
+}
+
+// Returns the type of the given value, immediate or not
+static inline valueType typeOf(Value *value) {
+    return isFixnum(value) ? INT_TYPE : value->type;
+}
+
 #endif
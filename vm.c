@@ -0,0 +1,613 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "gc.h"
+#include "interpreter.h"
+#include "number.h"
+#include "vm.h"
+#include "jit.h"
+
+// Dispatch jumps straight from one instruction to the next through a table of
+// label addresses when the compiler supports it, and uses a switch otherwise
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define COMPUTED_GOTO
+#endif
+
+// The state of a function that has called another one and is waiting for it
+// to return. base is where the function was on the value stack. check is the
+// error to cause if it returns something other than a boolean, or 0: and and
+// or need their second argument to be a boolean, but it's still in tail
+// position. Only the innermost check matters, since they all test the same
+// thing, so a tail call can keep just one. frames is where the frame stack
+// goes back to when the function returns.
+typedef struct Activation Activation;
+struct Activation {
+    Code *code;
+    uint32_t *ip;
+    Frame *frame;
+    int base;
+    int check;
+    void *frames;
+};
+
+// The value stack, shared by every activation. Everything below stackTop is
+// a root; the dispatch loop keeps its own stack pointer and stores it in
+// stackTop before anything that can allocate.
+Value **stack = NULL;
+Value **stackTop = NULL;
+size_t stackCapacity = 0;
+
+Activation *calls = NULL;
+int callCount = 0;
+int callCapacity = 0;
+
+// The top of the frame stack when the outermost vmRun started
+void *framesAtStart = NULL;
+
+// Lowers gcFrameLow to the given frames, the first ones that the function
+// being returned to may write
+static inline void lowerFrameLow(void *frames) {
+    if(frames < gcFrameLow) gcFrameLow = frames;
+}
+
+// Visits every value on the stack and the frames and code of the waiting
+// activations for the garbage collector. The running function may write any
+// of its frames after the collection, which start at or above those of the
+// function that called it.
+void visitStack() {
+    for(Value **p = stack; p < stackTop; p++) gcVisit((void **)p);
+    for(int i = 0; i < callCount; i++) {
+        gcVisit((void **)&calls[i].code);
+        gcVisit((void **)&calls[i].frame);
+    }
+    lowerFrameLow(callCount ? calls[callCount - 1].frames : framesAtStart);
+}
+
+// Makes sure there is room for the given number of values above sp, moving
+// the stack if needed, and returns the possibly moved sp
+Value **reserveStack(Value **sp, int needed) {
+    size_t used = sp - stack;
+    if(used + needed <= stackCapacity) return sp;
+    if(stack == NULL) gcAddRoots(visitStack);
+    while(used + needed > stackCapacity) {
+        stackCapacity = stackCapacity ? stackCapacity * 2 : 1024;
+    }
+    stack = realloc(stack, stackCapacity * sizeof(Value *));
+    if(stack == NULL) texit(1);
+    stackTop = stack + used;
+    return stackTop;
+}
+
+// Saves the state of the current function before it calls another one
+void pushActivation(Code *code, uint32_t *ip, Frame *frame, int base, int check,
+    void *frames) {
+    if(callCount == callCapacity) {
+        callCapacity = callCapacity ? callCapacity * 2 : 256;
+        calls = realloc(calls, callCapacity * sizeof(Activation));
+        if(calls == NULL) texit(1);
+    }
+    calls[callCount].code = code;
+    calls[callCount].ip = ip;
+    calls[callCount].frame = frame;
+    calls[callCount].base = base;
+    calls[callCount].check = check;
+    calls[callCount].frames = frames;
+    callCount++;
+}
+
+// Calls the given primitive with the top argc values of the stack as its
+// arguments, which it reads in place
+// Causes the primitive's arity error if it doesn't take that many arguments
+static inline Value *callPrimitive(Value *primitive, Value **sp, int argc) {
+    if(argc < primitive->prim.minArgs ||
+        (primitive->prim.maxArgs >= 0 && argc > primitive->prim.maxArgs)) {
+        evalError(primitive->prim.arityError);
+    }
+    return primitive->prim.function(argc, sp - argc);
+}
+
+// Caches the call at the given site, which is about to call the given
+// primitive with the top argc values of the stack: turns it into the
+// primitive's fixnum instruction if there is one and there are two fixnum
+// arguments, and marks it uncached otherwise. Machine code from the JIT
+// still calls through a site that the VM has since turned into a fixnum
+// instruction, which is left alone, since its operand only says whether
+// it's a tail call.
+void cacheCall(uint32_t *site, Value *primitive, Value **sp, int argc) {
+    opcode op = *site & 0xff;
+    if(op != OP_CALL && op != OP_TAILCALL) return;
+    bool tail = op == OP_TAILCALL;
+    if(argc == 2 && primitive->prim.fixnumOp && isFixnum(sp[-2]) && isFixnum(sp[-1])) {
+        *site = primitive->prim.fixnumOp | (uint32_t)tail << OPERAND_SHIFT;
+    } else *site |= (uint32_t)CALL_UNCACHED << OPERAND_SHIFT;
+}
+
+// Turns the fixnum instruction at the given site back into the call it came
+// from, marked uncached
+void uncacheCall(uint32_t *site) {
+    opcode op = *site >> OPERAND_SHIFT ? OP_TAILCALL : OP_CALL;
+    *site = op | (uint32_t)(2 | CALL_UNCACHED) << OPERAND_SHIFT;
+}
+
+// Makes the frame for a call of the closure below the top argc values of the
+// stack, with the arguments in its first slots
+// Causes an evaluation error if there are not enough or too many arguments
+Frame *enterClosure(Value **sp, int argc) {
+    Code *code = sp[-argc - 1]->cl.code;
+    if(argc < code->paramCount) evalError(14);
+    if(argc > code->paramCount) evalError(15);
+    Frame *frame = gcPushFrame(code->frameSize);
+    frame->parent = sp[-argc - 1]->cl.frame;
+    memcpy(frame->slots, sp - argc, argc * sizeof(Value *));
+    return frame;
+}
+
+// Makes a closure of the given code that captures the top count values of the
+// stack
+Value *makeFlatClosure(Value **sp, Code *code, int count) {
+    Frame *captures = NULL;
+    if(count > 0) {
+        captures = gcAllocFrame(count);
+        memcpy(captures->slots, sp - count, count * sizeof(Value *));
+    }
+    return makeClosure(code, captures);
+}
+
+// Puts the given slot of the given frame in a new box, which is a cell with
+// no name
+void boxSlot(Frame *frame, int index) {
+    Value *box = gcAllocValue();
+    box->type = BINDING_TYPE;
+    box->b.var = NULL;
+    box->b.val = frame->slots[index];
+    frame->slots[index] = box;
+    gcWriteBarrier(frame, box);
+}
+
+// Returns the frame the given number of levels above the given frame
+Frame *frameAt(Frame *frame, int depth) {
+    while(depth > 0) {
+        frame = frame->parent;
+        depth--;
+    }
+    return frame;
+}
+
+// Counts a call of the given closure code, and has the JIT compile it once
+// the code is hot
+static inline void countCall(Code *code) {
+    if(jitEnabled && code->native == NULL && ++code->calls == JIT_THRESHOLD) {
+        jitCompile(code);
+    }
+}
+
+// Runs the given code in the given frame and returns its result. Calls
+// between closures don't use the C stack, and tail calls reuse the current
+// activation, so Scheme recursion is only limited by memory. Each function
+// pops the frames it pushed on the frame stack when it returns or makes a
+// tail call.
+Value *vmRun(Code *code, Frame *frame) {
+    assert(code);
+    assert(frame);
+    Value **sp = reserveStack(stackTop, code->maxStack);
+    int entry = callCount;
+    void *frames = gcFrameTop;
+    if(entry == 0) framesAtStart = frames;
+    int base = sp - stack;
+    int check = 0;
+    uint32_t *ip = code->ops;
+    uint32_t word;
+    Value *value;
+    Frame *target;
+
+#ifdef COMPUTED_GOTO
+#define OPCODE_LABEL(name) &&do_##name,
+    static void *labels[] = {OPCODES(OPCODE_LABEL)};
+#define CASE(name) do_##name:
+#define DISPATCH() goto *labels[(word = *ip++) & 0xff]
+#else
+#define CASE(name) case name:
+#define DISPATCH() continue
+#endif
+
+#define OPERAND (word >> OPERAND_SHIFT)
+#define SAVE() (stackTop = sp)
+
+// Switches to the machine code for the current function, if it has been
+// compiled, at the instruction ip points to. Only used where the VM has just
+// started running a function or come back to one, so the instruction the
+// code leaves to the VM at always runs here before the code is entered again.
+#define ENTER_NATIVE() if(code->native != NULL) goto runNative
+
+    ENTER_NATIVE();
+#ifdef COMPUTED_GOTO
+    DISPATCH();
+#else
+    for(;;) {
+    word = *ip++;
+    switch(word & 0xff) {
+#endif
+
+    CASE(OP_CONSTANT) {
+        *sp++ = code->constants[OPERAND];
+        DISPATCH();
+    }
+    CASE(OP_VOID) {
+        *sp++ = makeVoid();
+        DISPATCH();
+    }
+    CASE(OP_LOCAL) {
+        value = frameAt(frame, OPERAND)->slots[*ip++];
+        if(value == NULL) evalError(4);
+        *sp++ = value;
+        DISPATCH();
+    }
+    CASE(OP_LOCAL0) {
+        *sp++ = frame->slots[OPERAND];
+        DISPATCH();
+    }
+    CASE(OP_LOCAL1) {
+        *sp++ = frame->parent->slots[OPERAND];
+        DISPATCH();
+    }
+    CASE(OP_GLOBAL) {
+        value = code->constants[OPERAND]->b.val;
+        if(value == NULL) evalError(4);
+        *sp++ = value;
+        DISPATCH();
+    }
+    CASE(OP_STORE_LOCAL) {
+        target = frameAt(frame, OPERAND);
+        target->slots[*ip++] = *--sp;
+        gcWriteBarrier(target, *sp);
+        DISPATCH();
+    }
+    CASE(OP_STORE_LOCAL0) {
+        frame->slots[OPERAND] = *--sp;
+        gcWriteBarrier(frame, *sp);
+        DISPATCH();
+    }
+    CASE(OP_ASSIGN_LOCAL) {
+        target = frameAt(frame, OPERAND);
+        if(target->slots[*ip] == NULL) evalError(4);
+        target->slots[*ip++] = *--sp;
+        gcWriteBarrier(target, *sp);
+        DISPATCH();
+    }
+    CASE(OP_STORE_GLOBAL) {
+        value = code->constants[OPERAND];
+        value->b.val = *--sp;
+        gcWriteBarrier(value, *sp);
+        DISPATCH();
+    }
+    CASE(OP_ASSIGN_GLOBAL) {
+        value = code->constants[OPERAND];
+        if(value->b.val == NULL) evalError(4);
+        value->b.val = *--sp;
+        gcWriteBarrier(value, *sp);
+        DISPATCH();
+    }
+    CASE(OP_BOX) {
+        SAVE();
+        boxSlot(frame, OPERAND);
+        DISPATCH();
+    }
+    CASE(OP_UNBOX) {
+        value = sp[-1]->b.val;
+        if(value == NULL) evalError(4);
+        sp[-1] = value;
+        DISPATCH();
+    }
+    CASE(OP_STORE_BOX) {
+        value = *--sp;
+        value->b.val = *--sp;
+        gcWriteBarrier(value, *sp);
+        DISPATCH();
+    }
+    CASE(OP_ASSIGN_BOX) {
+        value = *--sp;
+        if(value->b.val == NULL) evalError(4);
+        value->b.val = *--sp;
+        gcWriteBarrier(value, *sp);
+        DISPATCH();
+    }
+    CASE(OP_POP) {
+        sp--;
+        DISPATCH();
+    }
+    CASE(OP_DUP) {
+        sp[0] = sp[-1];
+        sp++;
+        DISPATCH();
+    }
+    CASE(OP_CHECK_BOOL) {
+        if(typeOf(sp[-1]) != BOOL_TYPE) evalError(OPERAND);
+        DISPATCH();
+    }
+    CASE(OP_JUMP) {
+        ip = code->ops + OPERAND;
+        DISPATCH();
+    }
+    CASE(OP_JUMP_IF_FALSE) {
+        value = *--sp;
+        if(typeOf(value) != BOOL_TYPE || !value->i) ip = code->ops + OPERAND;
+        DISPATCH();
+    }
+    CASE(OP_JUMP_IF_TRUE) {
+        value = *--sp;
+        if(typeOf(value) == BOOL_TYPE && value->i) ip = code->ops + OPERAND;
+        DISPATCH();
+    }
+    CASE(OP_ENTER) {
+        int count = *ip++;
+        SAVE();
+        target = gcPushFrame(OPERAND);
+        target->parent = frame;
+        sp -= count;
+        memcpy(target->slots, sp, count * sizeof(Value *));
+        frame = target;
+        DISPATCH();
+    }
+    CASE(OP_LEAVE) {
+        frame = frame->parent;
+        DISPATCH();
+    }
+    CASE(OP_CLOSURE) {
+        int count = *ip++;
+        SAVE();
+        value = makeFlatClosure(sp, (Code *)code->constants[OPERAND], count);
+        sp -= count;
+        *sp++ = value;
+        DISPATCH();
+    }
+    CASE(OP_CAPTURE) {
+        target = sp[-2]->cl.frame;
+        target->slots[OPERAND] = sp[-1];
+        gcWriteBarrier(target, sp[-1]);
+        sp -= 2;
+        DISPATCH();
+    }
+    CASE(OP_CALL) {
+        int argc = CALL_ARGC(OPERAND);
+        value = sp[-argc - 1];
+        SAVE();
+        if(typeOf(value) == PRIMITIVE_TYPE) {
+            if(!(OPERAND & CALL_UNCACHED)) cacheCall(ip - 1, value, sp, argc);
+            value = callPrimitive(value, sp, argc);
+            sp -= argc + 1;
+            *sp++ = value;
+            ENTER_NATIVE();
+            DISPATCH();
+        }
+        assert(typeOf(value) == CLOSURE_TYPE);
+        void *mark = gcFrameTop;
+        target = enterClosure(sp, argc);
+        pushActivation(code, ip, frame, base, check, frames);
+        frames = mark;
+        check = 0;
+        sp -= argc + 1;
+        base = sp - stack;
+        code = sp[0]->cl.code;
+        sp = reserveStack(sp, code->maxStack);
+        frame = target;
+        ip = code->ops;
+        countCall(code);
+        ENTER_NATIVE();
+        DISPATCH();
+    }
+    CASE(OP_TAILCALL) {
+        int argc = CALL_ARGC(OPERAND);
+        value = sp[-argc - 1];
+        SAVE();
+        if(typeOf(value) == PRIMITIVE_TYPE) {
+            if(!(OPERAND & CALL_UNCACHED)) cacheCall(ip - 1, value, sp, argc);
+            value = callPrimitive(value, sp, argc);
+            sp -= argc + 1;
+            *sp++ = value;
+            goto doReturn;
+        }
+        assert(typeOf(value) == CLOSURE_TYPE);
+        gcFrameTop = frames;
+        target = enterClosure(sp, argc);
+        code = sp[-argc - 1]->cl.code;
+        sp = reserveStack(stack + base, code->maxStack);
+        frame = target;
+        ip = code->ops;
+        countCall(code);
+        ENTER_NATIVE();
+        DISPATCH();
+    }
+
+// A fixnum instruction: if the cache still holds, works out value from the
+// fixnums x and y with the given statement and returns it if the operand is
+// 1, and otherwise turns back into a call and runs as that
+#define FIXNUM_OP(name, statement) \
+    CASE(name) { \
+        if(typeOf(sp[-3]) != PRIMITIVE_TYPE || sp[-3]->prim.fixnumOp != name || \
+            !isFixnum(sp[-2]) || !isFixnum(sp[-1])) { \
+            uncacheCall(--ip); \
+            DISPATCH(); \
+        } \
+        intptr_t x = fixnumValue(sp[-2]); \
+        intptr_t y = fixnumValue(sp[-1]); \
+        SAVE(); \
+        statement; \
+        sp -= 3; \
+        *sp++ = value; \
+        if(OPERAND) goto doReturn; \
+        DISPATCH(); \
+    }
+
+    FIXNUM_OP(OP_ADD_FIXNUMS, value = makeInteger(x + y))
+    FIXNUM_OP(OP_SUBTRACT_FIXNUMS, value = makeInteger(x - y))
+    FIXNUM_OP(OP_MULTIPLY_FIXNUMS, {
+        intptr_t product;
+        if(__builtin_mul_overflow(x, y, &product)) value = callPrimitive(sp[-3], sp, 2);
+        else value = makeInteger(product);
+    })
+    FIXNUM_OP(OP_LESS_FIXNUMS, value = makeBool(x < y))
+    FIXNUM_OP(OP_GREATER_FIXNUMS, value = makeBool(x > y))
+    FIXNUM_OP(OP_EQUAL_FIXNUMS, value = makeBool(x == y))
+    FIXNUM_OP(OP_LESS_EQUAL_FIXNUMS, value = makeBool(x <= y))
+    FIXNUM_OP(OP_GREATER_EQUAL_FIXNUMS, value = makeBool(x >= y))
+
+    CASE(OP_RETURN) {
+    doReturn:
+        value = sp[-1];
+        if(check && typeOf(value) != BOOL_TYPE) evalError(check);
+        sp = stack + base;
+        gcFrameTop = frames;
+        if(callCount == entry) {
+            stackTop = sp;
+            lowerFrameLow(framesAtStart);
+            return value;
+        }
+        callCount--;
+        code = calls[callCount].code;
+        ip = calls[callCount].ip;
+        frame = calls[callCount].frame;
+        base = calls[callCount].base;
+        check = calls[callCount].check;
+        frames = calls[callCount].frames;
+        lowerFrameLow(frames);
+        *sp++ = value;
+        ENTER_NATIVE();
+        DISPATCH();
+    }
+    CASE(OP_CHECK_RETURN) {
+        check = OPERAND;
+        DISPATCH();
+    }
+    CASE(OP_ERROR) {
+        evalError(OPERAND);
+        DISPATCH();
+    }
+
+    // runs machine code until it leaves, and goes on from wherever that is
+    runNative: {
+        VMState state = {code, ip, sp, frame, base, check, entry, frames};
+        jitRun(&state);
+        code = state.code;
+        ip = state.ip;
+        sp = state.sp;
+        frame = state.frame;
+        base = state.base;
+        check = state.check;
+        frames = state.frames;
+        if(ip == NULL) goto doReturn;
+        DISPATCH();
+    }
+
+#ifndef COMPUTED_GOTO
+    }
+    }
+#endif
+    return NULL;
+}
+
+// Calls the function below the top argc values of state's stack for the call
+// instruction at site in machine code
+void *vmCall(VMState *state, uint32_t *site, int argc) {
+    Value **sp = state->sp;
+    Value *callee = sp[-argc - 1];
+    stackTop = sp;
+    if(typeOf(callee) == PRIMITIVE_TYPE) {
+        if(!((*site >> OPERAND_SHIFT) & CALL_UNCACHED)) cacheCall(site, callee, sp, argc);
+        Value *value = callPrimitive(callee, sp, argc);
+        sp -= argc + 1;
+        *sp++ = value;
+        state->sp = sp;
+        return jitResume(state, site + 1);
+    }
+    assert(typeOf(callee) == CLOSURE_TYPE);
+    void *mark = gcFrameTop;
+    Frame *frame = enterClosure(sp, argc);
+    pushActivation(state->code, site + 1, state->frame, state->base, state->check,
+        state->frames);
+    state->frames = mark;
+    state->check = 0;
+    sp -= argc + 1;
+    state->base = sp - stack;
+    state->code = callee->cl.code;
+    state->sp = reserveStack(sp, state->code->maxStack);
+    state->frame = frame;
+    countCall(state->code);
+    return jitResume(state, state->code->ops);
+}
+
+// Calls the function below the top argc values of state's stack in place of
+// the current one for the tail call instruction at site in machine code
+void *vmTailCall(VMState *state, uint32_t *site, int argc) {
+    Value **sp = state->sp;
+    Value *callee = sp[-argc - 1];
+    stackTop = sp;
+    if(typeOf(callee) == PRIMITIVE_TYPE) {
+        if(!((*site >> OPERAND_SHIFT) & CALL_UNCACHED)) cacheCall(site, callee, sp, argc);
+        Value *value = callPrimitive(callee, sp, argc);
+        sp -= argc + 1;
+        *sp++ = value;
+        state->sp = sp;
+        return vmReturn(state);
+    }
+    assert(typeOf(callee) == CLOSURE_TYPE);
+    gcFrameTop = state->frames;
+    state->frame = enterClosure(sp, argc);
+    state->code = callee->cl.code;
+    state->sp = reserveStack(stack + state->base, state->code->maxStack);
+    countCall(state->code);
+    return jitResume(state, state->code->ops);
+}
+
+// Returns the top of state's stack from the current function in machine code.
+// Returning from the function vmRun was called with is left to vmRun.
+void *vmReturn(VMState *state) {
+    if(callCount == state->entry) return jitResume(state, NULL);
+    Value *value = state->sp[-1];
+    if(state->check && typeOf(value) != BOOL_TYPE) evalError(state->check);
+    Value **sp = stack + state->base;
+    gcFrameTop = state->frames;
+    callCount--;
+    state->code = calls[callCount].code;
+    state->frame = calls[callCount].frame;
+    state->base = calls[callCount].base;
+    state->check = calls[callCount].check;
+    state->frames = calls[callCount].frames;
+    lowerFrameLow(state->frames);
+    *sp++ = value;
+    state->sp = sp;
+    return jitResume(state, calls[callCount].ip);
+}
+
+// Makes a frame for OP_ENTER in machine code
+Frame *vmEnterFrame(Value **sp, Frame *frame, int size, int count) {
+    stackTop = sp;
+    Frame *target = gcPushFrame(size);
+    target->parent = frame;
+    memcpy(target->slots, sp - count, count * sizeof(Value *));
+    return target;
+}
+
+// Makes a closure for OP_CLOSURE in machine code
+Value *vmMakeClosure(Value **sp, Code *code, int count) {
+    stackTop = sp;
+    return makeFlatClosure(sp, code, count);
+}
+
+// Puts a slot in a box for OP_BOX in machine code
+void vmBox(Value **sp, Frame *frame, int index) {
+    stackTop = sp;
+    boxSlot(frame, index);
+}
+
+// Empties the value stack, the waiting activations and the frame stack
+void vmReset() {
+    stackTop = stack;
+    callCount = 0;
+    gcFrameTop = framesAtStart;
+    lowerFrameLow(framesAtStart);
+}
@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include "value.h"
+#include "interpreter.h"
+
+#ifndef _VM
+#define _VM
+
+// The instructions of the virtual machine. Each one is a 32-bit word with the
+// opcode in the low byte and an operand, called a below, in the high 24 bits.
+// The general local variable instructions take the depth as a and the slot
+// index in the word that follows; the common cases have instructions of their
+// own that take the slot as a and skip the depth walk and the check for an
+// unassigned variable where the resolver has shown it can't happen. Jump
+// targets are indexes into the code.
+//
+// Closures are flat: a closure holds a frame of its own with the values of the
+// variables it captures, which is the parent of the frame of each call. A
+// captured variable that can change after it's captured lives in a box, an
+// unnamed cell like a global's, and the frame it belongs to and every closure
+// that captures it hold the box instead.
+#define OPCODES(X) \
+    X(OP_CONSTANT)      /* push constants[a] */ \
+    X(OP_VOID)          /* push a void value */ \
+    X(OP_LOCAL)         /* push a local, error if it's unassigned */ \
+    X(OP_LOCAL0)        /* push slot a of the current frame, which is */ \
+                        /* always assigned */ \
+    X(OP_LOCAL1)        /* push slot a of the enclosing frame, which is */ \
+                        /* always assigned */ \
+    X(OP_GLOBAL)        /* push the value of the global cell constants[a] */ \
+    X(OP_STORE_LOCAL)   /* pop into a local */ \
+    X(OP_STORE_LOCAL0)  /* pop into slot a of the current frame */ \
+    X(OP_ASSIGN_LOCAL)  /* pop into a local, error if it's unassigned */ \
+    X(OP_STORE_GLOBAL)  /* pop into the global cell constants[a] */ \
+    X(OP_ASSIGN_GLOBAL) /* pop into a global, error if it's undefined */ \
+    X(OP_BOX)           /* put slot a of the current frame in a new box */ \
+    X(OP_UNBOX)         /* replace the box on top with what it holds, */ \
+                        /* error if it's unassigned */ \
+    X(OP_STORE_BOX)     /* pop a box, then pop into it */ \
+    X(OP_ASSIGN_BOX)    /* pop a box, then pop into it, error if it's */ \
+                        /* unassigned */ \
+    X(OP_POP)           /* drop the top of the stack */ \
+    X(OP_DUP)           /* push the top of the stack again */ \
+    X(OP_CHECK_BOOL)    /* error a if the top isn't a boolean */ \
+    X(OP_JUMP)          /* jump to a */ \
+    X(OP_JUMP_IF_FALSE) /* pop, and jump to a unless it was #t */ \
+    X(OP_JUMP_IF_TRUE)  /* pop, and jump to a if it was #t */ \
+    X(OP_ENTER)         /* make a frame with a slots, popping the number of */ \
+                        /* values in the next word into its first slots */ \
+    X(OP_LEAVE)         /* go back to the enclosing frame */ \
+    X(OP_CLOSURE)       /* push a closure of the code in constants[a], */ \
+                        /* popping the number of values in the next word */ \
+                        /* into its captures */ \
+    X(OP_CAPTURE)       /* pop into capture a of the closure below, */ \
+                        /* then pop that */ \
+    X(OP_CALL)          /* call the function below a arguments */ \
+    X(OP_TAILCALL)      /* call it in place of the current function */ \
+    X(OP_ADD_FIXNUMS)   /* cached calls of primitives on two fixnums, */ \
+    X(OP_SUBTRACT_FIXNUMS) /* which return if a is 1; see below */ \
+    X(OP_MULTIPLY_FIXNUMS) \
+    X(OP_LESS_FIXNUMS) \
+    X(OP_GREATER_FIXNUMS) \
+    X(OP_EQUAL_FIXNUMS) \
+    X(OP_LESS_EQUAL_FIXNUMS) \
+    X(OP_GREATER_EQUAL_FIXNUMS) \
+    X(OP_RETURN)        /* return the top of the stack to the caller */ \
+    X(OP_CHECK_RETURN)  /* error a if the current function doesn't return */ \
+                        /* a boolean */ \
+    X(OP_ERROR)         /* cause evaluation error a */
+
+// Each call instruction is its own inline cache. The first time a call of a
+// primitive with two arguments runs, if the primitive has a fixnum
+// instruction and both arguments are fixnums, the call rewrites itself into
+// that instruction, which works on the fixnums directly. The fixnum
+// instruction checks that the function below the arguments is still that
+// primitive and that they're still fixnums, so redefining the primitive's
+// name is caught. If not, it turns back into a call marked CALL_UNCACHED,
+// which never tries again, and runs as that.
+#define CALL_UNCACHED (1 << 23)
+#define CALL_ARGC(operand) ((operand) & (CALL_UNCACHED - 1))
+
+#define OPCODE_ENUM(name) name,
+typedef enum {OPCODES(OPCODE_ENUM) OPCODE_COUNT} opcode;
+
+#define OPERAND_SHIFT 8
+#define MAX_OPERAND ((1 << 24) - 1)
+
+// A compiled lambda body or top level expression. The constants and the
+// instructions are stored in the same allocation, which lives in the old
+// generation so that instruction pointers stay valid. Nested code objects for
+// lambdas are stored among the constants. Since closures don't keep the frame
+// they were made in, no frame can be reached once its function has returned
+// or made a tail call, so they all go on the collector's frame stack. calls
+// counts the calls of the code until the JIT compiles it, after which native
+// holds the machine code address of each instruction, or NULL for the words
+// that are operands.
+typedef struct Code Code;
+struct Code {
+    int paramCount;
+    int frameSize;
+    int maxStack;
+    int length;
+    int constantCount;
+    int calls;
+    void **native;
+    uint32_t *ops;
+    Value *constants[];
+};
+
+// The registers of the dispatch loop, which it hands to machine code from the
+// JIT and takes back when that code leaves. ip is NULL when the code left by
+// returning from the function vmRun was called with, which is the call at
+// depth entry. frames is the top the frame stack had when the current
+// function was called, which its return or tail call pops back to.
+typedef struct VMState VMState;
+struct VMState {
+    Code *code;
+    uint32_t *ip;
+    Value **sp;
+    Frame *frame;
+    int base;
+    int check;
+    int entry;
+    void *frames;
+};
+
+// Runs the given code in the given frame and returns its result
+Value *vmRun(Code *code, Frame *frame);
+
+// The instructions that machine code from the JIT leaves to the VM. The
+// calls take the site of the call instruction and its number of arguments.
+// Each one does what its instruction does to the state, and returns the
+// machine code address to go on from, which is the JIT's exit if the code to
+// go on in hasn't been compiled.
+void *vmCall(VMState *state, uint32_t *site, int argc);
+void *vmTailCall(VMState *state, uint32_t *site, int argc);
+void *vmReturn(VMState *state);
+
+// Makes a frame of the given size for OP_ENTER, filled with the top count
+// values below sp, which it doesn't pop
+Frame *vmEnterFrame(Value **sp, Frame *frame, int size, int count);
+
+// Makes a closure for OP_CLOSURE that captures the top count values below sp,
+// which it doesn't pop
+Value *vmMakeClosure(Value **sp, Code *code, int count);
+
+// Puts the given slot of the given frame in a box for OP_BOX, with everything
+// below sp being kept alive
+void vmBox(Value **sp, Frame *frame, int index);
+
+// Abandons every function that is running, after an error has jumped out of
+// vmRun
+void vmReset();
+
+#endif